@@ -0,0 +1,90 @@
+#ifndef AOT_H
+#define AOT_H
+
+// Interface between the runtime and modules generated by chip8_aot.
+// Generated code includes only this header so that a module can be built
+// without SDL or the rest of the emulator.
+
+#include <cstring>
+#include <stdexcept>
+#include "defs.h"
+
+#define CHIP8_AOT_ABI_VERSION 2
+
+static const int AOT_MEMORY_SIZE = 4096;
+// addresses wrap to 12 bits, as in the interpreter
+static const int AOT_ADDRESS_MASK = AOT_MEMORY_SIZE - 1;
+
+// Pointers into the machine executing the block.
+struct AotContext {
+    Byte* memory;
+    Byte* V;
+    DoubleByte* I;
+    Byte* sp;
+    DoubleByte* stack;
+    Byte* screen;
+    Byte* delay_timer;
+    Byte* sound_timer;
+    std::uint32_t* rng_state;
+    unsigned long keys;
+    // nonzero for every byte covered by compiled code
+    const Byte* code_map;
+    int executed;
+    bool update_screen;
+    bool code_written;
+};
+
+// Runs one basic block and returns the address execution continues at.
+typedef DoubleByte (*AotBlock)(AotContext*);
+
+struct AotModule {
+    int abi_version;
+    // program the module was compiled from, loaded at PROGRAM_START_ADDRESS
+    const Byte* rom;
+    int rom_size;
+    // AOT_MEMORY_SIZE entries, null where no block starts
+    const AotBlock* blocks;
+    const Byte* code_map;
+};
+
+extern "C" typedef const AotModule* (*AotModuleEntry)();
+#define CHIP8_AOT_ENTRY "chip8_aot_module"
+
+// Helpers used by generated code. They mirror the interpreter exactly.
+
+inline void aot_store(AotContext* c, int addr, Byte value) {
+    addr &= AOT_ADDRESS_MASK;
+    c->memory[addr] = value;
+    if (c->code_map[addr]) {
+        c->code_written = true;
+    }
+}
+
+inline bool aot_key(const AotContext* c, Byte key) {
+    if (key >= 16) {
+        throw std::out_of_range("aot_key");
+    }
+    return (c->keys >> key) & 1;
+}
+
+inline void aot_draw(AotContext* c, Byte X, Byte Y, Byte N) {
+    Byte* V = c->V;
+    V[0xF] = 0;
+    for (int yline = 0; yline < N; yline++) {
+
+        Byte pixel = c->memory[(*c->I + yline) & AOT_ADDRESS_MASK];
+        for(int xline = 0; xline < 8; xline++) {
+
+            if((pixel & (0x80 >> xline)) != 0) {
+
+                if(c->screen[(V[X] + xline + ((V[Y] + yline) * SCREEN_WIDTH)) % (2048)] == 1) {
+                    V[0xF] = 1;
+                }
+                c->screen[(V[X] + xline + ((V[Y] + yline) * SCREEN_WIDTH)) % (2048)] ^= 1;
+            }
+        }
+    }
+    c->update_screen = true;
+}
+
+#endif // AOT_H
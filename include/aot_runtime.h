@@ -0,0 +1,49 @@
+#ifndef AOT_RUNTIME_H
+#define AOT_RUNTIME_H
+
+#include <string>
+#include "aot.h"
+#include "chip8.h"
+
+// A module produced by chip8_aot and built as a shared library.
+class AotPlugin {
+
+public:
+    explicit AotPlugin(const std::string& path);
+    ~AotPlugin();
+
+    AotPlugin(const AotPlugin&) = delete;
+    AotPlugin& operator=(const AotPlugin&) = delete;
+
+    // true if the module was compiled from the program loaded in chip8
+    bool matches(const Chip8& chip8) const;
+    bool has_block(DoubleByte addr) const;
+
+    // Runs the compiled block at pc. Where there is none (computed BNNN
+    // targets, FX0A) a single instruction is interpreted instead. Once the
+    // machine writes over compiled code, code_valid is cleared and the
+    // machine stays on the interpreter. Returns the instructions retired.
+    int execute(Chip8& chip8, bool& code_valid) const;
+
+private:
+    void* handle;
+    const AotModule* module;
+};
+
+struct AotReport {
+    long instructions;
+    long compiled_instructions;
+    bool equivalent;
+    DoubleByte divergence_pc;
+    double interpreter_ns;
+    double compiled_ns;
+    std::string error;
+};
+
+// Runs the plugin and the interpreter in lockstep from initial, ticking the
+// timers and pressing the same pseudo random keys every timer cycle, and
+// compares the full machine state after every block; then times both
+// separately on the same run.
+AotReport aot_validate(const Chip8& initial, const AotPlugin& plugin, long instructions);
+
+#endif // AOT_RUNTIME_H
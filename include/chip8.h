@@ -4,10 +4,8 @@
 #include <iostream>
 #include <map>
 #include <bitset>
-#include <vector>
 #include "defs.h"
-#include "display.h"
-#include "keyboard.h"
+#include "decode_cache.h"
 
 
 static Byte chip8_fontset[] =
@@ -31,51 +29,117 @@ static Byte chip8_fontset[] =
 };
 
 
-class Chip8 {
+class Chip8;
+class AotPlugin;
+struct DisplayOptions;
+
+// Execution hooks for run_application. The hook type is a template parameter,
+// so with NullHooks every call is inlined away and the loop is unchanged.
+// Hooks whose before_step can stop execution to wait for the user set
+// interactive, and run_application then presents every draw as it happens
+// instead of pacing frames, so the window is current whenever they stop,
+// and reads the keyboard before every instruction, so keys pressed while
+// stopped reach the instruction that runs next.
+struct NullHooks {
+    static const bool interactive = false;
+
+    void before_step(Chip8&) {}
+    void after_step(Chip8&, DoubleByte) {}
+};
+
+// Machine state only: the SDL display and keyboard are owned by
+// run_application, so a Chip8 is trivially copyable and can be reset or
+// forked with a single memcpy (see MachinePool).
+class alignas(64) Chip8 {
+
+    friend class Debugger;
+    friend class AotPlugin;
+    friend class TraceHooks;
 
 public:
     Chip8();
-    ~Chip8();
 
     static const int memory_size = 4096;
     static const int num_registers = 16;
     static const int stack_size = 16;
     static const int num_keys = 16;
     static const DoubleByte font_address = 0x0000;
+    // addresses are 12 bits and wrap; nothing may reach past memory, which
+    // in a MachinePool is followed by the next machine
+    static const DoubleByte address_mask = 0x0FFF;
     static const int INSTRUCTIONS_PER_CYCLE;
     static const int SLEEP_TIME_BETWEEN_CYCLES_MS;
-    const DoubleByte PROGRAM_START_ADDRESS = 0x0200;
-
-    void run_application(const std::string&);
+    static const DoubleByte PROGRAM_START_ADDRESS = 0x0200;
+
+    void run_application(const std::string&, const DisplayOptions& options);
+    template<typename Hooks>
+    void run_application(const std::string&, const DisplayOptions& options, Hooks& hooks);
+    void run_compiled(const std::string&, const DisplayOptions& options, const AotPlugin& plugin);
+
+    // Address range written by opcode when executed with the given I,
+    // false if the opcode does not write to memory. first is wrapped to 12
+    // bits; last is first + length - 1, so past memory_size if the write
+    // wraps round to the start.
+    static bool memory_write_range(DoubleByte opcode, DoubleByte I, DoubleByte& first, DoubleByte& last);
+    // Parses an opcode pattern such as DXYN or F033, where X, Y and N match
+    // any nibble, into the value and mask of its fixed nibbles.
+    static bool parse_opcode_pattern(const std::string& text, DoubleByte& pattern, DoubleByte& mask);
+
+    // headless use
+    void reset();
+    void load_program(const std::string&);
+    void step();
+    template<typename Hooks>
+    void step(Hooks& hooks);
+    // Runs the pre-decoded, possibly fused, instruction at pc and returns
+    // the number of instructions it retired.
+    int step(DecodeCache& cache);
+    // Runs one timer cycle of INSTRUCTIONS_PER_CYCLE instructions, less the
+    // carry left by fused instructions overrunning the previous cycle, then
+    // ticks the timers. Returns true if the screen was drawn to.
+    bool run_cycle(DecodeCache& cache, int& carry);
+    void update_timers();
+    void set_keys(const std::bitset<num_keys>& pressed) { keys = pressed; }
+    DoubleByte program_counter() const { return pc; }
+    const Byte* registers() const { return V; }
+    const Byte* ram() const { return memory; }
+    const Byte* screen() const { return screen_buffer; }
+    bool screen_updated() const { return update_screen; }
+    // compares machine state, ignoring the per-instruction screen flag
+    bool operator==(const Chip8& other) const;
+    bool operator!=(const Chip8& other) const { return !(*this == other); }
+    // hash of everything that affects future execution except the keys
+    std::uint64_t state_hash() const;
 private:
 
+    // registers first so that they share a cache line
     DoubleByte pc;
     DoubleByte I;
     Byte sp;
-    Byte V[num_registers];
-    DoubleByte stack[stack_size];
-    std::vector<Byte> memory;
-    Display display;
-    Byte screen_buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
     Byte delay_timer;
     Byte sound_timer;
-    Keyboard keyboard;
-    std::bitset<num_keys> keys;
     bool update_screen;
+    std::uint32_t rng_state;
+    Byte V[num_registers];
+    DoubleByte stack[stack_size];
+    std::bitset<num_keys> keys;
+    Byte screen_buffer[SCREEN_WIDTH * SCREEN_HEIGHT];
+    Byte memory[memory_size];
 
-    void reset();
     void load_program_in_memory(const std::string&);
     void load_font_in_memory();
+    // The window loop shared by the run functions: execute runs the next
+    // instruction or compiled block and returns the instructions retired.
+    // interactive is the hooks' flag of the same name.
+    template<typename Execute>
+    void run_display(const DisplayOptions& options, bool interactive, Execute execute);
     DoubleByte fetch_instruction();
     void inc_program_counter();
     void dec_program_counter();
     DoubleByte decode_instruction(DoubleByte);
-    void step();
-    void update_timers();
-
     // debug
     void dump_screenbuffer();
-    void dump_program();
+    void dump_program(DoubleByte from = PROGRAM_START_ADDRESS, DoubleByte to = memory_size - 2);
 
 
     // instructions
@@ -118,4 +182,26 @@ private:
 
 
 
+template<typename Hooks>
+void Chip8::step(Hooks& hooks) {
+
+    DoubleByte opcode;
+
+    hooks.before_step(*this);
+    opcode = fetch_instruction();
+    decode_instruction(opcode);
+    hooks.after_step(*this, opcode);
+}
+
+// Presses a pseudo random key on half of the cycles, for headless runs.
+inline std::bitset<Chip8::num_keys> random_keys(std::uint32_t& seed) {
+
+    std::bitset<Chip8::num_keys> keys;
+    Byte r = next_random(seed);
+    if (r & 0x80) {
+        keys.set(r & 0x0F);
+    }
+    return keys;
+}
+
 #endif // CHIP8_H
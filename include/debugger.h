@@ -0,0 +1,51 @@
+#ifndef DEBUGGER_H
+#define DEBUGGER_H
+
+#include <set>
+#include <string>
+#include <utility>
+#include "defs.h"
+
+class Chip8;
+
+// Interactive terminal debugger. Passed to Chip8::run_application as the
+// execution hooks, so builds that don't use it pay nothing for it.
+class Debugger {
+
+public:
+    // stops at a prompt, so every draw is presented at once and keys are
+    // read before every step
+    static const bool interactive = true;
+
+    Debugger();
+    ~Debugger() {};
+
+    void before_step(Chip8& chip8);
+    void after_step(Chip8& chip8, DoubleByte opcode);
+
+private:
+    enum class Mode { Run, Step, StepOver };
+
+    Mode mode;
+    // opcode breakpoints, as (pattern, mask of fixed nibbles) pairs; 8XY0
+    // and 8NNN share a pattern but are different breakpoints
+    std::set<std::pair<DoubleByte, DoubleByte> > opcode_breakpoints;
+    std::set<DoubleByte> breakpoints;
+    std::set<DoubleByte> watchpoints;
+    DoubleByte step_over_return;
+    Byte step_over_sp;
+    std::string last_command;
+
+    static DoubleByte peek_opcode(const Chip8& chip8, DoubleByte addr);
+    bool should_break(const Chip8& chip8, DoubleByte opcode);
+    void repl(Chip8& chip8);
+
+    void print_location(const Chip8& chip8);
+    void print_registers(const Chip8& chip8);
+    void print_stack(const Chip8& chip8);
+    void print_memory(const Chip8& chip8, DoubleByte addr, int length);
+    void print_breakpoints();
+    void print_help();
+};
+
+#endif // DEBUGGER_H
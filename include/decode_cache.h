@@ -0,0 +1,65 @@
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <vector>
+#include "defs.h"
+
+// Instructions decoded once per address into a kind per opcode, with
+// their operands extracted, so Chip8::step(DecodeCache&) dispatches each
+// with a single switch. When fusion is on, the most frequent sequences
+// reported by chip8_ngrams are decoded into a single superinstruction.
+//
+// A cache belongs to one machine: clear() it after loading a program, and
+// Chip8 invalidates the entries covering any memory it writes.
+class DecodeCache {
+
+public:
+    enum Kind : Byte {
+        Undecoded,
+        Invalid,
+        Op00E0, Op00EE, Op1NNN, Op2NNN, Op3XNN, Op4XNN, Op5XY0, Op6XNN, Op7XNN,
+        Op8XY0, Op8XY1, Op8XY2, Op8XY3, Op8XY4, Op8XY5, Op8XY6, Op8XY7, Op8XYE,
+        Op9XY0, OpANNN, OpBNNN, OpCXNN, OpDXYN, OpEX9E, OpEXA1,
+        OpFX07, OpFX0A, OpFX15, OpFX18, OpFX1E, OpFX29, OpFX33, OpFX55, OpFX65,
+        LoadDraw,   // ANNN DXYN
+        LoadLoad,   // 6XNN 6YNN
+        WaitTimer,  // FX07 3X00 1NNN
+        CountLoop   // 7XNN 3XNN 1NNN
+    };
+
+    struct Entry {
+        Byte kind;
+        Byte X;
+        Byte Y;
+        Byte N;
+        Byte NN;
+        Byte NN2;
+        DoubleByte NNN;
+        DoubleByte opcode;
+    };
+
+    // longest fused sequence, in bytes
+    static const int max_span = 6;
+
+    explicit DecodeCache(bool fuse = true);
+    ~DecodeCache() {};
+
+    const Entry& lookup(const Byte* memory, DoubleByte pc) {
+        Entry& entry = entries[pc];
+        if (entry.kind == Undecoded) {
+            decode(memory, pc, entry);
+        }
+        return entry;
+    }
+
+    void invalidate(DoubleByte first, DoubleByte last);
+    void clear();
+
+private:
+    void decode(const Byte* memory, DoubleByte pc, Entry& entry) const;
+
+    std::vector<Entry> entries;
+    bool fuse;
+};
+
+#endif // DECODE_CACHE_H
@@ -9,4 +9,13 @@ typedef std::uint16_t DoubleByte;
 static const int SCREEN_WIDTH = 64;
 static const int SCREEN_HEIGHT = 32;
 
+// xorshift32, kept in machine state so that runs are reproducible and
+// compiled code draws the same numbers as the interpreter
+inline Byte next_random(std::uint32_t& state) {
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<Byte>(state >> 24);
+}
+
 #endif // DEFS_H
@@ -3,12 +3,25 @@
 
 #include <SDL2/SDL.h>
 #include "defs.h"
+#include "scaler.h"
 #include <memory>
 
+static const int default_window_scale = 10;
+
+struct DisplayOptions {
+    ScaleFilter filter = ScaleFilter::Nearest;
+    // 0 sizes the window to the smallest whole multiple of the filtered
+    // screen that is at least default_window_scale times the CHIP-8 screen
+    int window_width = 0;
+    int window_height = 0;
+    // scale by whole multiples only, otherwise fill the window keeping the aspect ratio
+    bool integer_scaling = true;
+};
+
 class Display {
 
 public:
-    Display();
+    explicit Display(const DisplayOptions& options = DisplayOptions());
     ~Display();
 
     // White
@@ -22,11 +35,19 @@ private:
     bool init();
     void close();
     void clear();
+    SDL_Rect target_rect();
 
+    DisplayOptions options;
+    Scaler scaler;
     std::shared_ptr<SDL_Window> window;
     std::shared_ptr<SDL_Renderer> renderer;
-    const int pixel_scale = 10;
+    std::shared_ptr<SDL_Texture> texture;
 
 };
 
+// SDL object factories, throwing std::runtime_error on failure
+std::unique_ptr<SDL_Window, void(*)(SDL_Window*)> make_window(const char *title, int x, int y, int w, int h, Uint32 flags);
+std::unique_ptr<SDL_Renderer, void(*)(SDL_Renderer*)> make_renderer(SDL_Window* pw);
+std::unique_ptr<SDL_Texture, void(*)(SDL_Texture*)> make_texture(SDL_Renderer* pr, int w, int h);
+
 #endif // DISPLAY_H
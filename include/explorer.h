@@ -0,0 +1,64 @@
+#ifndef EXPLORER_H
+#define EXPLORER_H
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "chip8.h"
+
+struct ExplorerOptions {
+    enum class Algorithm { Beam, Mcts };
+
+    Algorithm algorithm = Algorithm::Beam;
+    // actions along a path; each action holds one key (or none)
+    int depth = 60;
+    // timer cycles each action lasts
+    int cycles_per_action = 1;
+    int beam_width = 256;
+    // MCTS iterations, split over the threads
+    long iterations = 100000;
+    double exploration = 1.4;
+    // 0 uses one thread per hardware thread
+    int threads = 0;
+    std::uint32_t seed = 1;
+};
+
+struct ExplorerResult {
+    double best_score;
+    // key held during each action, -1 for none
+    std::vector<int> actions;
+    long expanded;
+    long duplicates;
+    long failed;
+    double seconds;
+};
+
+// Searches the key inputs of a ROM for the path maximising an objective.
+// Machines are forked at timer cycle boundaries by copying the whole state;
+// states already reached, by hash of memory, registers and screen, are not
+// expanded again: across the whole beam search, and within each thread's
+// tree for MCTS.
+class Explorer {
+
+public:
+    // score of a machine state, higher is better; must be thread safe
+    typedef std::function<double(const Chip8&)> Objective;
+
+    static const int num_actions = Chip8::num_keys + 1;
+
+    Explorer(const Chip8& start, Objective objective, const ExplorerOptions& options);
+    ~Explorer() {};
+
+    ExplorerResult run();
+
+private:
+    const Chip8& start;
+    Objective objective;
+    ExplorerOptions options;
+    int thread_count;
+
+    ExplorerResult run_beam();
+    ExplorerResult run_mcts();
+};
+
+#endif // EXPLORER_H
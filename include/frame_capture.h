@@ -0,0 +1,127 @@
+#ifndef FRAME_CAPTURE_H
+#define FRAME_CAPTURE_H
+
+#include <condition_variable>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "defs.h"
+
+enum class CaptureFormat { Y4m, Pbm };
+
+struct FrameCaptureOptions {
+    CaptureFormat format = CaptureFormat::Y4m;
+    // frame buffers shared by every stream
+    int buffers = 4096;
+    // a submit finding every buffer in use waits for one; otherwise it drops
+    // the frame, and that stream ends there
+    bool wait_for_buffers = true;
+    // 0 uses one encoder per hardware thread
+    int threads = 0;
+    // frames per second written in the Y4M header
+    int frame_rate = 50;
+};
+
+struct CaptureStats {
+    long frames;
+    long duplicates;
+    long dropped;
+};
+
+class FrameCapture;
+
+// One captured machine: a .y4m file, or a numbered sequence of .pbm
+// images. A stream must only be submitted to from one thread at a time.
+class CaptureStream {
+
+    friend class FrameCapture;
+
+public:
+    CaptureStream(const std::string& path, int encoder): path(path), encoder(encoder),
+        last_hash(0), frames(0), duplicates(0), dropped(0), written(0) {}
+    ~CaptureStream() {};
+
+private:
+    std::string path;
+    int encoder;
+
+    // submitting thread
+    std::uint64_t last_hash;
+    long frames;
+    long duplicates;
+    long dropped;
+
+    // encoder thread
+    std::ofstream out;
+    Byte last[SCREEN_WIDTH * SCREEN_HEIGHT];
+    long written;
+};
+
+// Captures frames off the emulating threads. submit() hashes the screen,
+// skips it if it matches the stream's previous frame, and otherwise copies
+// it into a pooled buffer queued to the stream's encoder thread. It only
+// waits on encoding or I/O when every buffer is in use, and not even then
+// if wait_for_buffers is off. Each stream always goes to the same encoder,
+// so its frames are written in order.
+//
+// Skipped frames still count: a Y4M stream repeats the previous frame, and
+// a PBM sequence, whose files are numbered by frame, has a gap. A dropped
+// frame can't be shown that way, so a stream that drops one is cut short
+// before it rather than repeat a frame that differed.
+class FrameCapture {
+
+public:
+    FrameCapture(const FrameCaptureOptions& options);
+    // writes out every submitted frame; producers must have stopped
+    ~FrameCapture();
+
+    FrameCapture(const FrameCapture&) = delete;
+    FrameCapture& operator=(const FrameCapture&) = delete;
+
+    // path without extension; the stream is valid for the capture's lifetime
+    CaptureStream& open_stream(const std::string& path);
+
+    // Returns false if the frame was dropped, because every buffer was in use
+    // without wait_for_buffers or because the stream had already dropped one.
+    bool submit(CaptureStream& stream, const Byte* screen);
+
+    // totals over every stream, exact once producers have stopped
+    CaptureStats stats();
+
+private:
+    static const int frame_size = SCREEN_WIDTH * SCREEN_HEIGHT;
+
+    struct Job {
+        CaptureStream* stream;
+        long frame;
+        Byte* buffer;
+    };
+
+    struct Encoder {
+        std::mutex mutex;
+        std::condition_variable ready;
+        std::condition_variable freed;
+        std::vector<Job> jobs;
+        // this encoder's share of the frame buffers
+        std::vector<Byte*> free_buffers;
+        bool stopping;
+        std::thread thread;
+    };
+
+    FrameCaptureOptions options;
+    std::unique_ptr<Byte[]> buffers;
+    std::vector<std::unique_ptr<Encoder> > encoders;
+
+    std::mutex streams_mutex;
+    std::vector<std::unique_ptr<CaptureStream> > streams;
+
+    void encode(Encoder& encoder);
+    void write(CaptureStream& stream, long frame, const Byte* screen);
+    void finish(CaptureStream& stream);
+};
+
+#endif // FRAME_CAPTURE_H
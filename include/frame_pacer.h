@@ -0,0 +1,73 @@
+#ifndef FRAME_PACER_H
+#define FRAME_PACER_H
+
+#include <chrono>
+#include <iostream>
+#include <vector>
+
+struct FramePacerStats {
+    // timer cycles that drew to the screen
+    long frames;
+    long presented;
+    // frames replaced by a newer one before they could be presented
+    long dropped;
+    // presents that finished after the next timer cycle was due
+    long late;
+    // timer cycles given up because emulation fell too far behind
+    long lost_cycles;
+    // smoothed time spent in one present, in milliseconds
+    double render_ms;
+};
+
+// Keeps emulation on a fixed timer cycle deadline whatever presenting the
+// screen costs, and decides which of the frames drawn are worth showing.
+//
+// cycles_due() returns how many timer cycles to run to catch up with the
+// clock. A cycle that drew hands its frame over with frame_ready(); only
+// the latest frame is kept, and should_present() allows it out no more
+// often than the display refreshes, nor more often than the measured
+// render cost leaves a quarter of the time to emulation. On a slow host
+// fewer frames are shown, but the game and its timers keep their speed.
+class FramePacer {
+
+public:
+    // at most 32, so a batch of cycles fits a bit mask
+    static const int MAX_CATCH_UP_CYCLES = 10;
+    static const int REFRESH_RATE = 60;
+
+    explicit FramePacer(std::chrono::milliseconds cycle_period);
+    ~FramePacer() {};
+
+    int cycles_due();
+    void frame_ready();
+    bool should_present() const;
+    // bracket the present of the pending frame
+    void begin_present();
+    void end_present();
+    // sleeps until the next timer cycle is due
+    void wait();
+
+    FramePacerStats stats() const;
+    // counters and the distribution of time between presented frames
+    void report(std::ostream& out) const;
+
+private:
+    typedef std::chrono::steady_clock clock;
+    // frame time histogram, in 1ms buckets; the last one holds anything longer
+    static const int histogram_size = 250;
+
+    clock::duration cycle_period;
+    clock::duration refresh_period;
+    clock::time_point next_cycle;
+    clock::time_point present_start;
+    clock::time_point last_present_start;
+    clock::time_point last_present;
+    bool pending;
+    clock::duration render_cost;
+    FramePacerStats counts;
+    std::vector<long> frame_times;
+
+    double frame_time_percentile(double fraction) const;
+};
+
+#endif // FRAME_PACER_H
@@ -12,7 +12,8 @@ public:
     Keyboard();
     ~Keyboard() {};
 
-    void read_key(std::bitset<16>& keys);
+    // false once the window has been closed
+    bool read_key(std::bitset<16>& keys);
 private:
    std::map<SDL_Keycode, Byte> keymap;
 
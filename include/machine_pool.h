@@ -0,0 +1,89 @@
+#ifndef MACHINE_POOL_H
+#define MACHINE_POOL_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+// Fixed-capacity arena of Chip8 machines. Every slot is cache-line aligned
+// and sits in one contiguous allocation; acquire() and reset() copy the ROM
+// template (font and program already loaded) with a single memcpy.
+//
+// A pool is not thread safe: give each worker thread its own pool and
+// construct it on that thread, after pin_to_numa_node(). The constructor
+// writes every slot, so with the kernel's first-touch policy the arena is
+// placed on the node the worker then stays on.
+class MachinePool {
+
+public:
+    MachinePool(std::size_t capacity, const Chip8& rom_template);
+    ~MachinePool() {};
+
+    MachinePool(const MachinePool&) = delete;
+    MachinePool& operator=(const MachinePool&) = delete;
+
+    Chip8* acquire();
+    // acquires a slot holding a copy of parent instead of the template
+    Chip8* fork(const Chip8& parent);
+    void release(Chip8* machine);
+    void release_all();
+    void reset(Chip8* machine) const;
+
+    std::size_t capacity() const { return slot_count; }
+    std::size_t available() const { return free_slots.size(); }
+    const Chip8& rom_template() const { return *slots; }
+
+private:
+    std::unique_ptr<unsigned char[]> arena;
+    // slots[0] holds the template, machines start at slots[1]
+    Chip8* slots;
+    std::size_t slot_count;
+    std::vector<Chip8*> free_slots;
+};
+
+// Pins the calling thread to the CPUs of one NUMA node, as read from
+// /sys/devices/system/node; worker w of worker_count goes to node
+// w * nodes / worker_count, so neighbouring workers share a node. Returns
+// false, leaving the thread free to run anywhere, if there is only one
+// node or the layout can't be read.
+bool pin_to_numa_node(int worker, int worker_count);
+
+// A pooled machine run one timer cycle at a time on its own decode cache.
+struct RunningMachine {
+    Chip8* machine;
+    DecodeCache cache;
+    int carry;
+    // hit an invalid instruction; it is not run again
+    bool halted;
+
+    // Runs one timer cycle unless halted. Returns true if the screen was
+    // drawn to, or the machine halted during the cycle.
+    bool run_cycle();
+};
+
+// Instances first to last - 1 of a run that cycles through programs, so
+// instance i runs programs[i % programs.size()]: one MachinePool per
+// program, sized for this share of the instances. Like a pool, construct
+// it on the worker thread that runs it, once that thread is pinned.
+class MachineGroup {
+
+public:
+    MachineGroup(const std::vector<std::string>& programs, int first, int last);
+    ~MachineGroup() {};
+
+    MachineGroup(const MachineGroup&) = delete;
+    MachineGroup& operator=(const MachineGroup&) = delete;
+
+    int first() const { return first_instance; }
+    int last() const { return first_instance + static_cast<int>(machines.size()); }
+    // by instance number, first() to last() - 1
+    RunningMachine& operator[](int instance) { return *machines[instance - first_instance]; }
+
+private:
+    int first_instance;
+    std::vector<std::unique_ptr<MachinePool> > pools;
+    std::vector<std::unique_ptr<RunningMachine> > machines;
+};
+
+#endif // MACHINE_POOL_H
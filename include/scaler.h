@@ -0,0 +1,50 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <cstdint>
+#include <vector>
+#include "defs.h"
+
+enum class ScaleFilter { Nearest, Scale2x, Scale3x, Scale4x };
+
+// Converts the screen buffer to ARGB pixels, smoothing diagonals with the
+// Scale2x/Scale3x family of filters. The output is a small image (at most
+// 4x the screen) that the renderer stretches to the window in one copy.
+//
+// Output rows are kept between frames and only recomputed around the
+// source rows that changed.
+class Scaler {
+
+public:
+    Scaler(ScaleFilter filter, std::uint32_t foreground, std::uint32_t background);
+    ~Scaler() {};
+
+    int factor() const { return scale; }
+    int width() const { return SCREEN_WIDTH * scale; }
+    int height() const { return SCREEN_HEIGHT * scale; }
+    const std::uint32_t* pixels() const { return output.data(); }
+    int pitch() const { return width() * sizeof(std::uint32_t); }
+
+    // Rescales buffer, returning false if nothing changed. Otherwise
+    // [first_row, last_row] is the range of output rows rewritten.
+    bool update(const Byte buffer[], int& first_row, int& last_row);
+
+private:
+    ScaleFilter filter;
+    int scale;
+    // source rows on either side that affect a row's output
+    int radius;
+    std::uint32_t foreground;
+    std::uint32_t background;
+    bool valid;
+    Byte previous[SCREEN_WIDTH * SCREEN_HEIGHT];
+    // 0/1 pixels at 2x, the input of the second Scale4x pass
+    std::vector<Byte> stage;
+    // 0/1 pixels at the output size
+    std::vector<Byte> scaled;
+    std::vector<std::uint32_t> output;
+
+    void scale_rows(const Byte buffer[], int first, int last);
+};
+
+#endif // SCALER_H
@@ -0,0 +1,216 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "chip8.h"
+
+// One executed instruction. Registers are the values after it ran; the
+// bytes written by FX33/FX55 are not stored, they follow from VX and V0-VX.
+struct TraceRecord {
+    DoubleByte pc;
+    DoubleByte opcode;
+    DoubleByte I;
+    DoubleByte keys;
+    DoubleByte write_address;
+    // bytes written to memory, 0 if none
+    Byte write_length;
+    Byte sp;
+    Byte delay_timer;
+    Byte sound_timer;
+    Byte V[Chip8::num_registers];
+    Byte reserved[2];
+};
+
+static_assert(sizeof(TraceRecord) == 32, "trace records are fixed size");
+
+class TraceWriter;
+
+// Single producer, single consumer ring of records. The emulating thread
+// pushes, the TraceWriter thread pops; neither takes a lock. A full ring
+// makes the producer wait for the writer rather than lose records.
+class TraceBuffer {
+
+public:
+    static const std::size_t capacity = 1 << 16;
+    // records the writer encodes at a time
+    static const std::size_t chunk_records = 4096;
+
+    explicit TraceBuffer(TraceWriter& writer);
+    ~TraceBuffer() {};
+
+    TraceBuffer(const TraceBuffer&) = delete;
+    TraceBuffer& operator=(const TraceBuffer&) = delete;
+
+    // Producer side: fill in the slot returned by reserve, then commit it.
+    TraceRecord& reserve();
+    void commit();
+
+    // consumer side
+    std::size_t size() const;
+    std::size_t pop(TraceRecord* out, std::size_t max);
+
+    // times the producer found the ring full
+    long stall_count() const { return stalls.load(std::memory_order_relaxed); }
+
+private:
+    TraceWriter& writer;
+    std::unique_ptr<TraceRecord[]> records;
+    // head and tail kept on separate cache lines, padded rather than
+    // aligned so that buffers can be allocated with plain new
+    char head_padding[64];
+    std::atomic<std::size_t> head;
+    char tail_padding[64];
+    std::atomic<std::size_t> tail;
+    // producer's last view of head
+    std::size_t head_cache;
+    std::atomic<long> stalls;
+};
+
+// Owns the trace file and a background thread that drains every buffer,
+// delta-encodes the records and appends them in chunks. Chunks of
+// different buffers interleave in the file; each is tagged with its
+// buffer's stream number.
+//
+// File layout, in host byte order: "C8TR", version, record size, then
+// chunks of { stream, record count, payload bytes, payload }. In the
+// payload every record is XORed with the previous one of the chunk (pc as
+// the difference from pc + 2) and only its non-zero bytes are kept,
+// behind a mask saying which they are.
+class TraceWriter {
+
+public:
+    explicit TraceWriter(const std::string& path);
+    // drains what is left; every producer must have stopped pushing
+    ~TraceWriter();
+
+    TraceWriter(const TraceWriter&) = delete;
+    TraceWriter& operator=(const TraceWriter&) = delete;
+
+    // A new buffer for one producer thread, valid for the writer's lifetime.
+    TraceBuffer& open_buffer();
+
+    // Called by producers when a chunk is ready or their buffer is full.
+    void wake() {
+        if (!woken.exchange(true, std::memory_order_acq_rel)) {
+            ready.notify_one();
+        }
+    }
+
+private:
+    std::ofstream file;
+    // encoding scratch, used by the writer thread only
+    std::vector<Byte> payload;
+    std::mutex mutex;
+    std::vector<std::unique_ptr<TraceBuffer> > buffers;
+    std::condition_variable ready;
+    std::atomic<bool> woken;
+    std::atomic<bool> stopping;
+    std::thread thread;
+
+    void run();
+    void write_chunk(std::uint32_t stream, const TraceRecord* records, std::size_t count);
+};
+
+inline TraceRecord& TraceBuffer::reserve() {
+
+    std::size_t t = tail.load(std::memory_order_relaxed);
+    if (t - head_cache == capacity) {
+        head_cache = head.load(std::memory_order_acquire);
+        while (t - head_cache == capacity) {
+            stalls.fetch_add(1, std::memory_order_relaxed);
+            writer.wake();
+            std::this_thread::yield();
+            head_cache = head.load(std::memory_order_acquire);
+        }
+    }
+    return records[t & (capacity - 1)];
+}
+
+inline void TraceBuffer::commit() {
+
+    std::size_t t = tail.load(std::memory_order_relaxed) + 1;
+    tail.store(t, std::memory_order_release);
+
+    // a whole chunk is ready, don't leave it for the writer's next poll
+    if ((t & (chunk_records - 1)) == 0) {
+        writer.wake();
+    }
+}
+
+// Reads a trace back, record by record, in file order.
+class TraceReader {
+
+public:
+    explicit TraceReader(const std::string& path);
+    ~TraceReader() {};
+
+    // false at the end of the trace
+    bool next(TraceRecord& record, std::uint32_t& stream);
+
+    // bytes of the file read so far
+    long bytes_read() const { return bytes; }
+
+private:
+    std::ifstream in;
+    std::vector<Byte> payload;
+    std::size_t payload_size;
+    std::size_t offset;
+    std::uint32_t remaining;
+    std::uint32_t stream;
+    TraceRecord previous;
+    long bytes;
+};
+
+// Execution hooks recording every instruction into a TraceBuffer.
+class TraceHooks {
+
+public:
+    static const bool interactive = false;
+
+    explicit TraceHooks(TraceBuffer& buffer): buffer(buffer), pc(0), I(0) {}
+    ~TraceHooks() {};
+
+    void before_step(Chip8& chip8) {
+        pc = chip8.pc;
+        I = chip8.I;
+    }
+
+    void after_step(Chip8& chip8, DoubleByte opcode) {
+
+        // written straight into the ring
+        TraceRecord& record = buffer.reserve();
+        record.pc = pc;
+        record.opcode = opcode;
+        record.I = chip8.I;
+        record.keys = static_cast<DoubleByte>(chip8.keys.to_ulong());
+        record.write_address = 0;
+        record.write_length = 0;
+        DoubleByte first, last;
+        if ((opcode & 0xF000) == 0xF000 && Chip8::memory_write_range(opcode, I, first, last)) {
+            record.write_address = first;
+            record.write_length = static_cast<Byte>(last - first + 1);
+        }
+        record.sp = chip8.sp;
+        record.delay_timer = chip8.delay_timer;
+        record.sound_timer = chip8.sound_timer;
+        std::memcpy(record.V, chip8.V, sizeof(record.V));
+        record.reserved[0] = record.reserved[1] = 0;
+        buffer.commit();
+    }
+
+private:
+    TraceBuffer& buffer;
+    DoubleByte pc;
+    DoubleByte I;
+};
+
+#endif // TRACE_H
@@ -0,0 +1,78 @@
+#ifndef VIDEO_WALL_H
+#define VIDEO_WALL_H
+
+#include <SDL2/SDL.h>
+#include <bitset>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "machine_pool.h"
+
+struct VideoWallOptions {
+    int instances = 16;
+    // 0 uses one worker per hardware thread
+    int threads = 0;
+    int window_width = 1280;
+    int window_height = 720;
+};
+
+// Runs many machines in one process and shows them side by side in a
+// single window. Machines are split across worker threads, each holding
+// its machines in its own MachinePool; the main thread composites every
+// framebuffer into one texture atlas and presents it through a FramePacer,
+// reporting dropped and late frames when the window is closed.
+class VideoWall {
+
+public:
+    VideoWall(const std::vector<std::string>& programs, const VideoWallOptions& options);
+    ~VideoWall();
+
+    void run();
+
+private:
+    struct Instance {
+        RunningMachine* running;
+        // drawn to since the atlas was last updated
+        bool dirty;
+    };
+
+    static const int tile_width = SCREEN_WIDTH + 1;
+    static const int tile_height = SCREEN_HEIGHT + 1;
+
+    std::vector<std::string> programs;
+    VideoWallOptions options;
+    int columns;
+    int rows;
+
+    std::vector<std::thread> workers;
+    std::vector<Instance> instances;
+
+    // tick hand-off between the main thread and the workers
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable work_done;
+    unsigned long generation;
+    int pending;
+    int ticks;
+    // bit t set if any machine drew during tick t of the batch
+    std::uint32_t drawn_ticks;
+    std::bitset<Chip8::num_keys> keys;
+    bool stopping;
+
+    std::shared_ptr<SDL_Window> window;
+    std::shared_ptr<SDL_Renderer> renderer;
+    std::shared_ptr<SDL_Texture> atlas;
+    std::vector<std::uint32_t> pixels;
+
+    void work(int worker, int worker_count, int first, int last);
+    // returns the ticks that drew, as in drawn_ticks
+    std::uint32_t run_ticks(int count, const std::bitset<Chip8::num_keys>& pressed);
+    // returns false if no tile changed
+    bool compose(SDL_Rect& changed);
+    void present();
+};
+
+#endif // VIDEO_WALL_H
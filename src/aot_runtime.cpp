@@ -0,0 +1,160 @@
+#include "aot_runtime.h"
+#include <dlfcn.h>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+AotPlugin::AotPlugin(const std::string& path): handle(nullptr), module(nullptr) {
+
+    handle = dlopen(path.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        throw std::runtime_error(std::string("Can't load AOT module: ") + dlerror());
+    }
+
+    AotModuleEntry entry = reinterpret_cast<AotModuleEntry>(dlsym(handle, CHIP8_AOT_ENTRY));
+    if (!entry) {
+        dlclose(handle);
+        throw std::runtime_error("Not an AOT module: " + path);
+    }
+
+    module = entry();
+    if (module->abi_version != CHIP8_AOT_ABI_VERSION) {
+        dlclose(handle);
+        throw std::runtime_error("AOT module ABI mismatch: " + path);
+    }
+}
+
+AotPlugin::~AotPlugin() {
+    dlclose(handle);
+}
+
+bool AotPlugin::matches(const Chip8& chip8) const {
+
+    if (module->rom_size > Chip8::memory_size - Chip8::PROGRAM_START_ADDRESS) {
+        return false;
+    }
+    return std::equal(module->rom, module->rom + module->rom_size,
+                      chip8.memory + Chip8::PROGRAM_START_ADDRESS);
+}
+
+bool AotPlugin::has_block(DoubleByte addr) const {
+    return addr < Chip8::memory_size && module->blocks[addr] != nullptr;
+}
+
+int AotPlugin::execute(Chip8& chip8, bool& code_valid) const {
+
+    if (!code_valid || !has_block(chip8.pc)) {
+
+        DoubleByte opcode = (chip8.memory[chip8.pc] << 8) | chip8.memory[(chip8.pc + 1) & Chip8::address_mask];
+        chip8.step();
+
+        DoubleByte first, last;
+        if (code_valid && Chip8::memory_write_range(opcode, chip8.I, first, last)) {
+            for (int addr = first; addr <= last; addr++) {
+                if (module->code_map[addr & Chip8::address_mask]) {
+                    code_valid = false;
+                }
+            }
+        }
+        return 1;
+    }
+
+    AotContext c = {
+        chip8.memory, chip8.V, &chip8.I, &chip8.sp, chip8.stack, chip8.screen_buffer,
+        &chip8.delay_timer, &chip8.sound_timer, &chip8.rng_state, chip8.keys.to_ulong(),
+        module->code_map, 0, false, false
+    };
+
+    chip8.pc = module->blocks[chip8.pc](&c);
+    chip8.update_screen = c.update_screen;
+    if (c.code_written) {
+        code_valid = false;
+    }
+    return c.executed;
+}
+
+AotReport aot_validate(const Chip8& initial, const AotPlugin& plugin, long instructions) {
+
+    AotReport report = { 0, 0, true, 0, 0.0, 0.0, std::string() };
+
+    Chip8 compiled(initial);
+    Chip8 interpreted(initial);
+    bool code_valid = true;
+    std::uint32_t seed = 1;
+    long cycle_end = 0;
+    // instruction counts at which the timers ticked, replayed by the timed runs
+    std::vector<long> ticks;
+    ticks.reserve(instructions / Chip8::INSTRUCTIONS_PER_CYCLE + 1);
+
+    typedef std::chrono::steady_clock clock;
+
+    try {
+        while (report.instructions < instructions) {
+
+            // timers tick and keys change between blocks, as in run_compiled,
+            // where a block running past the end of a cycle carries over
+            if (report.instructions >= cycle_end) {
+                std::bitset<Chip8::num_keys> keys = random_keys(seed);
+                compiled.update_timers();
+                compiled.set_keys(keys);
+                interpreted.update_timers();
+                interpreted.set_keys(keys);
+                ticks.push_back(report.instructions);
+                cycle_end += Chip8::INSTRUCTIONS_PER_CYCLE;
+            }
+
+            bool in_block = code_valid && plugin.has_block(compiled.program_counter());
+            DoubleByte block_pc = compiled.program_counter();
+            int n = plugin.execute(compiled, code_valid);
+            for (int i = 0; i < n; i++) {
+                interpreted.step();
+            }
+
+            report.instructions += n;
+            if (in_block) {
+                report.compiled_instructions += n;
+            }
+            if (compiled != interpreted) {
+                report.equivalent = false;
+                report.divergence_pc = block_pc;
+                return report;
+            }
+        }
+
+        // the same run again, timed, each side on its own; ticking at the
+        // same instruction counts keeps both on the same path
+        interpreted = initial;
+        seed = 1;
+        std::size_t next_tick = 0;
+        clock::time_point start = clock::now();
+        for (long i = 0; i < report.instructions; i++) {
+            if (next_tick < ticks.size() && i == ticks[next_tick]) {
+                interpreted.update_timers();
+                interpreted.set_keys(random_keys(seed));
+                next_tick++;
+            }
+            interpreted.step();
+        }
+        report.interpreter_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+
+        compiled = initial;
+        code_valid = true;
+        seed = 1;
+        next_tick = 0;
+        start = clock::now();
+        for (long i = 0; i < report.instructions; ) {
+            if (next_tick < ticks.size() && i == ticks[next_tick]) {
+                compiled.update_timers();
+                compiled.set_keys(random_keys(seed));
+                next_tick++;
+            }
+            i += plugin.execute(compiled, code_valid);
+        }
+        report.compiled_ns = std::chrono::duration<double, std::nano>(clock::now() - start).count();
+    } catch (const std::exception& e) {
+        report.error = e.what();
+        return report;
+    }
+
+    return report;
+}
@@ -0,0 +1,92 @@
+#include "chip8.h"
+#include "debugger.h"
+#include "trace.h"
+#include "aot_runtime.h"
+#include "display.h"
+#include "keyboard.h"
+#include "frame_pacer.h"
+#include <chrono>
+
+template<typename Execute>
+void Chip8::run_display(const DisplayOptions& options, bool interactive, Execute execute) {
+
+    Display display(options);
+    Keyboard keyboard;
+    FramePacer pacer(std::chrono::milliseconds(Chip8::SLEEP_TIME_BETWEEN_CYCLES_MS));
+
+    auto present = [&] {
+        pacer.begin_present();
+        display.draw(screen_buffer);
+        pacer.end_present();
+    };
+
+    int executed = 0;
+
+    while (keyboard.read_key(keys)) {
+
+        // timer cycles run on their deadlines, however long presenting takes
+        for (int due = pacer.cycles_due(); due > 0; due--) {
+            bool drawn = false;
+            while (executed < Chip8::INSTRUCTIONS_PER_CYCLE) {
+                if (interactive && !keyboard.read_key(keys)) {
+                    pacer.report(std::cerr);
+                    return;
+                }
+                executed += execute();
+                if (update_screen && interactive) {
+                    pacer.frame_ready();
+                    present();
+                } else {
+                    drawn |= update_screen;
+                }
+            }
+
+            // a fused instruction or compiled block can run past the end of the cycle, carry the excess over
+            executed -= Chip8::INSTRUCTIONS_PER_CYCLE;
+
+            update_timers();
+            if (drawn) {
+                pacer.frame_ready();
+            }
+        }
+
+        if (pacer.should_present()) {
+            present();
+        }
+        pacer.wait();
+    }
+
+    pacer.report(std::cerr);
+}
+
+void Chip8::run_application(const std::string& program_name, const DisplayOptions& options) {
+
+    DecodeCache cache;
+
+    load_program(program_name);
+    run_display(options, false, [&] { return step(cache); });
+}
+
+template<typename Hooks>
+void Chip8::run_application(const std::string& program_name, const DisplayOptions& options, Hooks& hooks) {
+
+    load_program(program_name);
+    run_display(options, Hooks::interactive, [&] {
+        step(hooks);
+        return 1;
+    });
+}
+
+void Chip8::run_compiled(const std::string& program_name, const DisplayOptions& options, const AotPlugin& plugin) {
+
+    load_program(program_name);
+    if (!plugin.matches(*this)) {
+        throw std::runtime_error("AOT module was not compiled from " + program_name);
+    }
+
+    bool code_valid = true;
+    run_display(options, false, [&] { return plugin.execute(*this, code_valid); });
+}
+
+template void Chip8::run_application<Debugger>(const std::string&, const DisplayOptions&, Debugger&);
+template void Chip8::run_application<TraceHooks>(const std::string&, const DisplayOptions&, TraceHooks&);
@@ -4,59 +4,201 @@
 #include <cstdlib>
 #include <sstream>
 #include <iomanip>
-#include <chrono>
-#include <thread>
+#include <cctype>
 
 void invalid_instruction(int opcode);
 
 const int Chip8::INSTRUCTIONS_PER_CYCLE = 20;
 const int Chip8::SLEEP_TIME_BETWEEN_CYCLES_MS = 20;
 
-Chip8::Chip8(): pc(0), memory(memory_size), delay_timer(0), sound_timer(0), update_screen(false) {
+Chip8::Chip8() {
 
+    reset();
+}
+
+void Chip8::reset() {
+
+    pc = PROGRAM_START_ADDRESS;
+    I = 0;
+    sp = 0;
+    delay_timer = 0;
+    sound_timer = 0;
+    update_screen = false;
+    rng_state = 0x2545F491;
+    keys.reset();
     std::fill(std::begin(memory), std::end(memory), 0x00);
     std::fill(std::begin(screen_buffer), std::end(screen_buffer), 0x00);
     std::fill(std::begin(V), std::end(V), 0x00);
     std::fill(std::begin(stack), std::end(stack), 0x00);
+    load_font_in_memory();
 }
 
-Chip8::~Chip8() {
+void Chip8::load_program(const std::string& program_name) {
 
+    reset();
+    load_program_in_memory(program_name);
 }
 
 void Chip8::step() {
 
-    DoubleByte opcode;
+    NullHooks hooks;
+    step(hooks);
+}
+
+int Chip8::step(DecodeCache& cache) {
 
-    keyboard.read_key(keys);
-    opcode = fetch_instruction();
-    decode_instruction(opcode);
+    const DecodeCache::Entry& e = cache.lookup(memory, pc);
+    int retired = 1;
+    DoubleByte first, last;
+
+    // as in decode_instruction, pc is past the first instruction before it runs
+    inc_program_counter();
+    update_screen = false;
+
+    switch (e.kind) {
+
+        case DecodeCache::Op00E0: instruction_00E0(); break;
+        case DecodeCache::Op00EE: instruction_00EE(); break;
+        case DecodeCache::Op1NNN: instruction_1NNN(e.NNN); break;
+        case DecodeCache::Op2NNN: instruction_2NNN(e.NNN); break;
+        case DecodeCache::Op3XNN: instruction_3XNN(e.X, e.NN); break;
+        case DecodeCache::Op4XNN: instruction_4XNN(e.X, e.NN); break;
+        case DecodeCache::Op5XY0: instruction_5XY0(e.X, e.Y); break;
+        case DecodeCache::Op6XNN: instruction_6XNN(e.X, e.NN); break;
+        case DecodeCache::Op7XNN: instruction_7XNN(e.X, e.NN); break;
+        case DecodeCache::Op8XY0: instruction_8XY0(e.X, e.Y); break;
+        case DecodeCache::Op8XY1: instruction_8XY1(e.X, e.Y); break;
+        case DecodeCache::Op8XY2: instruction_8XY2(e.X, e.Y); break;
+        case DecodeCache::Op8XY3: instruction_8XY3(e.X, e.Y); break;
+        case DecodeCache::Op8XY4: instruction_8XY4(e.X, e.Y); break;
+        case DecodeCache::Op8XY5: instruction_8XY5(e.X, e.Y); break;
+        case DecodeCache::Op8XY6: instruction_8XY6(e.X); break;
+        case DecodeCache::Op8XY7: instruction_8XY7(e.X, e.Y); break;
+        case DecodeCache::Op8XYE: instruction_8XYE(e.X); break;
+        case DecodeCache::Op9XY0: instruction_9XY0(e.X, e.Y); break;
+        case DecodeCache::OpANNN: instruction_ANNN(e.NNN); break;
+        case DecodeCache::OpBNNN: instruction_BNNN(e.NNN); break;
+        case DecodeCache::OpCXNN: instruction_CXNN(e.X, e.NN); break;
+        case DecodeCache::OpDXYN: instruction_DXYN(e.X, e.Y, e.N); break;
+        case DecodeCache::OpEX9E: instruction_EX9E(e.X); break;
+        case DecodeCache::OpEXA1: instruction_EXA1(e.X); break;
+        case DecodeCache::OpFX07: instruction_FX07(e.X); break;
+        case DecodeCache::OpFX0A: instruction_FX0A(e.X); break;
+        case DecodeCache::OpFX15: instruction_FX15(e.X); break;
+        case DecodeCache::OpFX18: instruction_FX18(e.X); break;
+        case DecodeCache::OpFX1E: instruction_FX1E(e.X); break;
+        case DecodeCache::OpFX29: instruction_FX29(e.X); break;
+
+        case DecodeCache::OpFX33:
+            instruction_FX33(e.X);
+            memory_write_range(e.opcode, I, first, last);
+            cache.invalidate(first, last);
+        break;
+
+        case DecodeCache::OpFX55:
+            instruction_FX55(e.X);
+            memory_write_range(e.opcode, I, first, last);
+            cache.invalidate(first, last);
+        break;
+
+        case DecodeCache::OpFX65: instruction_FX65(e.X); break;
+
+        case DecodeCache::LoadDraw:
+            inc_program_counter();
+            instruction_ANNN(e.NNN);
+            instruction_DXYN(e.X, e.Y, e.N);
+            retired = 2;
+        break;
+
+        case DecodeCache::LoadLoad:
+            inc_program_counter();
+            instruction_6XNN(e.X, e.NN);
+            instruction_6XNN(e.Y, e.NN2);
+            retired = 2;
+        break;
+
+        case DecodeCache::WaitTimer:
+            // the jump only executes when the skip isn't taken
+            instruction_FX07(e.X);
+            if (V[e.X] == 0x00) {
+                pc = (pc + 4) & address_mask;
+                retired = 2;
+            } else {
+                pc = e.NNN;
+                retired = 3;
+            }
+        break;
+
+        case DecodeCache::CountLoop:
+            instruction_7XNN(e.X, e.NN);
+            if (V[e.X] == e.NN2) {
+                pc = (pc + 4) & address_mask;
+                retired = 2;
+            } else {
+                pc = e.NNN;
+                retired = 3;
+            }
+        break;
 
-    if (update_screen) {
-        display.draw(screen_buffer);
+        default:
+            invalid_instruction(e.opcode);
+        break;
     }
+
+    return retired;
 }
 
-void Chip8::run_application(const std::string& program_name) {
+bool Chip8::run_cycle(DecodeCache& cache, int& carry) {
 
-    load_program_in_memory(program_name);
-    load_font_in_memory();
-
-    pc = PROGRAM_START_ADDRESS;
+    bool drawn = false;
+    while (carry < INSTRUCTIONS_PER_CYCLE) {
+        carry += step(cache);
+        drawn |= update_screen;
+    }
+    carry -= INSTRUCTIONS_PER_CYCLE;
 
-    //dump_program();
-    //dump_screenbuffer();
+    update_timers();
+    return drawn;
+}
 
-    while(true) {
+bool Chip8::operator==(const Chip8& other) const {
 
-        for(int i = 0; i < Chip8::INSTRUCTIONS_PER_CYCLE; i++) {
-            step();
-        }
+    return pc == other.pc && I == other.I && sp == other.sp
+        && delay_timer == other.delay_timer && sound_timer == other.sound_timer
+        && rng_state == other.rng_state && keys == other.keys
+        && std::equal(std::begin(V), std::end(V), std::begin(other.V))
+        && std::equal(std::begin(stack), std::end(stack), std::begin(other.stack))
+        && std::equal(std::begin(screen_buffer), std::end(screen_buffer), std::begin(other.screen_buffer))
+        && std::equal(std::begin(memory), std::end(memory), std::begin(other.memory));
+}
 
-        update_timers();
-        std::this_thread::sleep_for(std::chrono::milliseconds(Chip8::SLEEP_TIME_BETWEEN_CYCLES_MS));
+// 64-bit multiply-xorshift mix over 8-byte words
+static std::uint64_t hash_bytes(std::uint64_t h, const void* data, std::size_t size) {
 
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    for (; size >= 8; size -= 8, p += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, p, 8);
+        h = (h ^ word) * 0x9E3779B97F4A7C15ULL;
+        h ^= h >> 29;
     }
+    for (; size > 0; size--, p++) {
+        h = (h ^ *p) * 0x100000001B3ULL;
+    }
+    return h;
+}
+
+std::uint64_t Chip8::state_hash() const {
+
+    DoubleByte registers[] = { pc, I, sp, delay_timer, sound_timer };
+    std::uint64_t h = 0xCBF29CE484222325ULL;
+    h = hash_bytes(h, registers, sizeof(registers));
+    h = hash_bytes(h, &rng_state, sizeof(rng_state));
+    h = hash_bytes(h, V, sizeof(V));
+    h = hash_bytes(h, stack, sizeof(stack));
+    h = hash_bytes(h, screen_buffer, sizeof(screen_buffer));
+    h = hash_bytes(h, memory, sizeof(memory));
+    return h ^ (h >> 32);
 }
 
 void Chip8::update_timers() {
@@ -68,15 +210,16 @@ void Chip8::update_timers() {
 
 void Chip8::load_program_in_memory(const std::string& program_name) {
 
-    std::ifstream program_file(program_name, std::ios::binary | std::ios::in);
+    std::ifstream program_file(program_name, std::ios::binary | std::ios::in | std::ios::ate);
     if (!program_file.is_open()) {
         std::cerr << "File not found: " << program_name << std::endl;
         std::abort();
     }
 
-    unsigned int size = program_file.tellg();
+    std::streamoff size = program_file.tellg();
+    program_file.seekg(0);
 
-    if (size >= memory_size - PROGRAM_START_ADDRESS) {
+    if (size > memory_size - PROGRAM_START_ADDRESS) {
         std::cerr << "Can't load. Program size too big." << std::endl;
         std::abort();
     }
@@ -105,18 +248,18 @@ DoubleByte Chip8::fetch_instruction() {
 
     DoubleByte opcode = memory[pc];
     opcode <<= 8;
-    opcode |= memory[pc+1];
+    opcode |= memory[(pc + 1) & address_mask];
 
     inc_program_counter();
     return opcode;
 }
 
 void Chip8::inc_program_counter() {
-    pc += 2;
+    pc = (pc + 2) & address_mask;
 }
 
 void Chip8::dec_program_counter() {
-    pc -= 2;
+    pc = (pc - 2) & address_mask;
 }
 
 DoubleByte Chip8::decode_instruction(DoubleByte opcode) {
@@ -311,7 +454,7 @@ void Chip8::instruction_00E0() {
 }
 
 void Chip8::instruction_00EE() {
-    pc = stack[--sp];
+    pc = stack[--sp] & address_mask;
 }
 
 void Chip8::instruction_1NNN(DoubleByte NNN) {
@@ -402,11 +545,11 @@ void Chip8::instruction_ANNN(DoubleByte NNN) {
 }
 
 void Chip8::instruction_BNNN(DoubleByte NNN) {
-    pc = V[0x0] + NNN;
+    pc = (V[0x0] + NNN) & address_mask;
 }
 
 void Chip8::instruction_CXNN(Byte X, Byte NN) {
-    V[X] = static_cast<Byte>(rand() % 256) & NN;
+    V[X] = next_random(rng_state) & NN;
 }
 
 void Chip8::instruction_DXYN(Byte X, Byte Y, Byte N) {
@@ -418,7 +561,7 @@ void Chip8::instruction_DXYN(Byte X, Byte Y, Byte N) {
     V[0xF] = 0;
     for (int yline = 0; yline < N; yline++) {
 
-        Byte pixel = memory[I + yline];
+        Byte pixel = memory[(I + yline) & address_mask];
         for(int xline = 0; xline < 8; xline++) {
 
             if((pixel & (0x80 >> xline)) != 0) {
@@ -472,7 +615,7 @@ void Chip8::instruction_FX18(Byte X) {
 }
 
 void Chip8::instruction_FX1E(Byte X) {
-    I += V[X];
+    I = (I + V[X]) & address_mask;
 }
 
 void Chip8::instruction_FX29(Byte X) {
@@ -481,9 +624,9 @@ void Chip8::instruction_FX29(Byte X) {
 
 void Chip8::instruction_FX33(Byte X) {
 
-    memory[I] =  V[X] / 100;
-    memory[I + 1] = (V[X] / 10) % 10;
-    memory[I + 2] = (V[X] % 100) % 10;
+    memory[I & address_mask] =  V[X] / 100;
+    memory[(I + 1) & address_mask] = (V[X] / 10) % 10;
+    memory[(I + 2) & address_mask] = (V[X] % 100) % 10;
 
 //    int n = V[X];
 //    int c = 2;
@@ -498,13 +641,13 @@ void Chip8::instruction_FX33(Byte X) {
 
 void Chip8::instruction_FX55(Byte X) {
     for (Byte i = 0; i <= X; i++) {
-        memory[I + i] = V[i];
+        memory[(I + i) & address_mask] = V[i];
     }
 }
 
 void Chip8::instruction_FX65(Byte X) {
     for (Byte i = 0; i <= X; i++) {
-        V[i] = memory[I + i];
+        V[i] = memory[(I + i) & address_mask];
     }
 }
 
@@ -519,20 +662,58 @@ void Chip8::dump_screenbuffer() {
     }
 }
 
-void Chip8::dump_program() {
+void Chip8::dump_program(DoubleByte from, DoubleByte to) {
 
-    pc = 0x0200;
+    // reads memory directly so that pc is left untouched
     std::cout << "PROGRAM START" << std::endl;
-    while(pc <= 0xFFF) {
-        DoubleByte opcode = fetch_instruction();
-        std::cout << std::setbase(16) << opcode << std::endl;
+    for (int addr = from; addr <= to && addr + 1 < memory_size; addr += 2) {
+        DoubleByte opcode = (memory[addr] << 8) | memory[addr + 1];
+        std::cout << std::hex << std::setfill('0')
+                  << std::setw(3) << addr << ": " << std::setw(4) << opcode
+                  << std::dec << std::endl;
     }
     std::cout << "PROGRAM END" << std::endl;
 
 }
 
+bool Chip8::memory_write_range(DoubleByte opcode, DoubleByte I, DoubleByte& first, DoubleByte& last) {
+
+    if ((opcode & 0xF0FF) == 0xF033) {
+        first = I & address_mask;
+        last = first + 2;
+        return true;
+    }
+    if ((opcode & 0xF0FF) == 0xF055) {
+        first = I & address_mask;
+        last = first + ((opcode & 0x0F00) >> 8);
+        return true;
+    }
+    return false;
+}
+
 void invalid_instruction(int opcode) {
     std::ostringstream oss("Invalid Instruction", std::ios::ate);
     oss << " " << std::hex << opcode;
     throw std::runtime_error(oss.str());
 }
+
+bool Chip8::parse_opcode_pattern(const std::string& text, DoubleByte& pattern, DoubleByte& mask) {
+
+    if (text.size() != 4) {
+        return false;
+    }
+
+    pattern = 0;
+    mask = 0;
+    for (char c : text) {
+        pattern <<= 4;
+        mask <<= 4;
+        if (std::isxdigit(static_cast<unsigned char>(c))) {
+            pattern |= std::stoi(std::string(1, c), nullptr, 16);
+            mask |= 0xF;
+        } else if (c != 'X' && c != 'Y' && c != 'N' && c != 'x' && c != 'y' && c != 'n') {
+            return false;
+        }
+    }
+    return true;
+}
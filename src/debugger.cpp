@@ -0,0 +1,286 @@
+#include "debugger.h"
+#include "chip8.h"
+#include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <cstdlib>
+
+static bool parse_address(const std::string& text, DoubleByte& addr);
+static std::string format_pattern(DoubleByte pattern, DoubleByte mask);
+
+Debugger::Debugger(): mode(Mode::Step), step_over_return(0), step_over_sp(0) {
+
+}
+
+void Debugger::before_step(Chip8& chip8) {
+
+    DoubleByte opcode = peek_opcode(chip8, chip8.pc);
+
+    if (should_break(chip8, opcode)) {
+        mode = Mode::Step;
+        print_location(chip8);
+        repl(chip8);
+    }
+}
+
+void Debugger::after_step(Chip8& chip8, DoubleByte opcode) {
+
+    DoubleByte first, last;
+    if (watchpoints.empty() || !Chip8::memory_write_range(opcode, chip8.I, first, last)) {
+        return;
+    }
+
+    for (int written = first; written <= last; written++) {
+        DoubleByte addr = written & Chip8::address_mask;
+        if (watchpoints.count(addr)) {
+            std::cout << std::hex << std::setfill('0')
+                      << "watchpoint " << std::setw(3) << addr
+                      << " = " << std::setw(2) << static_cast<int>(chip8.memory[addr])
+                      << std::dec << std::endl;
+            mode = Mode::Step;
+        }
+    }
+}
+
+bool Debugger::should_break(const Chip8& chip8, DoubleByte opcode) {
+
+    switch (mode) {
+        case Mode::Step:
+            return true;
+
+        case Mode::StepOver:
+            if (chip8.pc == step_over_return && chip8.sp == step_over_sp) {
+                return true;
+            }
+        break;
+
+        case Mode::Run:
+        break;
+    }
+
+    if (breakpoints.count(chip8.pc)) {
+        return true;
+    }
+
+    for (const auto& bp : opcode_breakpoints) {
+        if ((opcode & bp.second) == bp.first) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void Debugger::repl(Chip8& chip8) {
+
+    std::string line;
+    while (true) {
+
+        std::cout << "(chip8) " << std::flush;
+        if (!std::getline(std::cin, line)) {
+            std::exit(0);
+        }
+
+        // an empty line repeats the previous command
+        if (line.empty()) {
+            line = last_command;
+        }
+        last_command = line;
+
+        std::istringstream iss(line);
+        std::string cmd, arg;
+        iss >> cmd >> arg;
+
+        DoubleByte addr, pattern, mask;
+
+        if (cmd == "s" || cmd == "step") {
+            mode = Mode::Step;
+            return;
+
+        } else if (cmd == "n" || cmd == "next") {
+            if ((peek_opcode(chip8, chip8.pc) & 0xF000) == 0x2000) {
+                // run until the subroutine returns to the same stack depth
+                step_over_return = chip8.pc + 2;
+                step_over_sp = chip8.sp;
+                mode = Mode::StepOver;
+            } else {
+                mode = Mode::Step;
+            }
+            return;
+
+        } else if (cmd == "c" || cmd == "continue") {
+            mode = Mode::Run;
+            return;
+
+        } else if (cmd == "b" && parse_address(arg, addr)) {
+            breakpoints.insert(addr);
+
+        } else if (cmd == "db" && parse_address(arg, addr)) {
+            breakpoints.erase(addr);
+
+        } else if (cmd == "bo" && Chip8::parse_opcode_pattern(arg, pattern, mask)) {
+            opcode_breakpoints.insert(std::make_pair(pattern, mask));
+
+        } else if (cmd == "dbo" && Chip8::parse_opcode_pattern(arg, pattern, mask)) {
+            opcode_breakpoints.erase(std::make_pair(pattern, mask));
+
+        } else if (cmd == "w" && parse_address(arg, addr)) {
+            watchpoints.insert(addr);
+
+        } else if (cmd == "dw" && parse_address(arg, addr)) {
+            watchpoints.erase(addr);
+
+        } else if (cmd == "l" || cmd == "list") {
+            print_breakpoints();
+
+        } else if (cmd == "r" || cmd == "regs") {
+            print_registers(chip8);
+
+        } else if (cmd == "k" || cmd == "stack") {
+            print_stack(chip8);
+
+        } else if (cmd == "x" && parse_address(arg, addr)) {
+            int length = 16;
+            iss >> length;
+            print_memory(chip8, addr, length);
+
+        } else if (cmd == "u") {
+            if (!parse_address(arg, addr)) {
+                addr = chip8.pc;
+            }
+            int count = 8;
+            iss >> count;
+            chip8.dump_program(addr, addr + 2 * (count - 1));
+
+        } else if (cmd == "screen") {
+            chip8.dump_screenbuffer();
+            std::cout << std::endl;
+
+        } else if (cmd == "q" || cmd == "quit") {
+            std::exit(0);
+
+        } else {
+            print_help();
+        }
+    }
+}
+
+void Debugger::print_location(const Chip8& chip8) {
+
+    std::cout << std::hex << std::setfill('0')
+              << std::setw(3) << chip8.pc << ": "
+              << std::setw(4) << peek_opcode(chip8, chip8.pc)
+              << std::dec << std::endl;
+}
+
+void Debugger::print_registers(const Chip8& chip8) {
+
+    std::cout << std::hex << std::setfill('0');
+    for (int i = 0; i < Chip8::num_registers; i++) {
+        std::cout << "V" << std::uppercase << i << std::nouppercase
+                  << "=" << std::setw(2) << static_cast<int>(chip8.V[i])
+                  << ((i % 8 == 7) ? "\n" : " ");
+    }
+    std::cout << "pc=" << std::setw(3) << chip8.pc
+              << " I=" << std::setw(3) << chip8.I
+              << " sp=" << static_cast<int>(chip8.sp)
+              << " dt=" << std::setw(2) << static_cast<int>(chip8.delay_timer)
+              << " st=" << std::setw(2) << static_cast<int>(chip8.sound_timer)
+              << " keys=" << chip8.keys
+              << std::dec << std::endl;
+}
+
+void Debugger::print_stack(const Chip8& chip8) {
+
+    if (chip8.sp == 0) {
+        std::cout << "stack empty" << std::endl;
+        return;
+    }
+
+    std::cout << std::hex << std::setfill('0');
+    for (int i = chip8.sp - 1; i >= 0; i--) {
+        std::cout << "#" << std::dec << i << std::hex
+                  << " " << std::setw(3) << chip8.stack[i] << std::endl;
+    }
+    std::cout << std::dec;
+}
+
+void Debugger::print_memory(const Chip8& chip8, DoubleByte addr, int length) {
+
+    std::cout << std::hex << std::setfill('0');
+    for (int i = 0; i < length && addr + i < Chip8::memory_size; i++) {
+        if (i % 16 == 0) {
+            std::cout << (i ? "\n" : "") << std::setw(3) << addr + i << ":";
+        }
+        std::cout << " " << std::setw(2) << static_cast<int>(chip8.memory[addr + i]);
+    }
+    std::cout << std::dec << std::endl;
+}
+
+void Debugger::print_breakpoints() {
+
+    std::cout << std::hex << std::setfill('0');
+    for (DoubleByte addr : breakpoints) {
+        std::cout << "break " << std::setw(3) << addr << std::endl;
+    }
+    for (const auto& bp : opcode_breakpoints) {
+        std::cout << "break opcode " << format_pattern(bp.first, bp.second) << std::endl;
+    }
+    for (DoubleByte addr : watchpoints) {
+        std::cout << "watch " << std::setw(3) << addr << std::endl;
+    }
+    std::cout << std::dec;
+}
+
+void Debugger::print_help() {
+
+    std::cout <<
+        "s             step one instruction\n"
+        "n             step, running over 2NNN calls\n"
+        "c             continue until a breakpoint\n"
+        "b/db ADDR     set/delete pc breakpoint\n"
+        "bo/dbo OPCODE set/delete opcode breakpoint, X/Y/N match any nibble (e.g. DXYN, FX33)\n"
+        "w/dw ADDR     set/delete watchpoint on writes by FX33/FX55\n"
+        "l             list breakpoints and watchpoints\n"
+        "r             show registers\n"
+        "k             show call stack\n"
+        "x ADDR [LEN]  dump memory\n"
+        "u [ADDR] [N]  list N opcodes from ADDR (default pc)\n"
+        "screen        dump screen buffer\n"
+        "q             quit" << std::endl;
+}
+
+DoubleByte Debugger::peek_opcode(const Chip8& chip8, DoubleByte addr) {
+
+    if (addr + 1 >= Chip8::memory_size) {
+        return 0x0000;
+    }
+    return (chip8.memory[addr] << 8) | chip8.memory[addr + 1];
+}
+
+static bool parse_address(const std::string& text, DoubleByte& addr) {
+
+    if (text.empty()) {
+        return false;
+    }
+
+    char* end;
+    unsigned long value = std::strtoul(text.c_str(), &end, 16);
+    if (*end != '\0' || value >= Chip8::memory_size) {
+        return false;
+    }
+    addr = static_cast<DoubleByte>(value);
+    return true;
+}
+
+static std::string format_pattern(DoubleByte pattern, DoubleByte mask) {
+
+    std::string text;
+    for (int shift = 12; shift >= 0; shift -= 4) {
+        if ((mask >> shift) & 0xF) {
+            text += "0123456789ABCDEF"[(pattern >> shift) & 0xF];
+        } else {
+            text += 'N';
+        }
+    }
+    return text;
+}
@@ -0,0 +1,146 @@
+#include "decode_cache.h"
+#include <algorithm>
+
+static const int memory_size = 4096;
+
+DecodeCache::DecodeCache(bool fuse): entries(memory_size), fuse(fuse) {
+    clear();
+}
+
+// The kind of a single opcode, matched as Chip8::decode_instruction does.
+static Byte single_kind(DoubleByte op) {
+
+    switch (op & 0xF000) {
+        case 0x0000:
+            return op == 0x00E0 ? DecodeCache::Op00E0 : op == 0x00EE ? DecodeCache::Op00EE : DecodeCache::Invalid;
+        case 0x1000: return DecodeCache::Op1NNN;
+        case 0x2000: return DecodeCache::Op2NNN;
+        case 0x3000: return DecodeCache::Op3XNN;
+        case 0x4000: return DecodeCache::Op4XNN;
+        case 0x5000: return DecodeCache::Op5XY0;
+        case 0x6000: return DecodeCache::Op6XNN;
+        case 0x7000: return DecodeCache::Op7XNN;
+        case 0x8000:
+            switch (op & 0x000F) {
+                case 0x0: return DecodeCache::Op8XY0;
+                case 0x1: return DecodeCache::Op8XY1;
+                case 0x2: return DecodeCache::Op8XY2;
+                case 0x3: return DecodeCache::Op8XY3;
+                case 0x4: return DecodeCache::Op8XY4;
+                case 0x5: return DecodeCache::Op8XY5;
+                case 0x6: return DecodeCache::Op8XY6;
+                case 0x7: return DecodeCache::Op8XY7;
+                case 0xE: return DecodeCache::Op8XYE;
+            }
+            return DecodeCache::Invalid;
+        case 0x9000: return DecodeCache::Op9XY0;
+        case 0xA000: return DecodeCache::OpANNN;
+        case 0xB000: return DecodeCache::OpBNNN;
+        case 0xC000: return DecodeCache::OpCXNN;
+        case 0xD000: return DecodeCache::OpDXYN;
+        case 0xE000:
+            switch (op & 0x00FF) {
+                case 0x9E: return DecodeCache::OpEX9E;
+                case 0xA1: return DecodeCache::OpEXA1;
+            }
+            return DecodeCache::Invalid;
+        default:
+            switch (op & 0x00FF) {
+                case 0x07: return DecodeCache::OpFX07;
+                case 0x0A: return DecodeCache::OpFX0A;
+                case 0x15: return DecodeCache::OpFX15;
+                case 0x18: return DecodeCache::OpFX18;
+                case 0x1E: return DecodeCache::OpFX1E;
+                case 0x29: return DecodeCache::OpFX29;
+                case 0x33: return DecodeCache::OpFX33;
+                case 0x55: return DecodeCache::OpFX55;
+                case 0x65: return DecodeCache::OpFX65;
+            }
+            return DecodeCache::Invalid;
+    }
+}
+
+void DecodeCache::invalidate(DoubleByte first, DoubleByte last) {
+
+    // a fused entry starting up to max_span - 1 bytes earlier covers first,
+    // and an entry at the last address reads the first byte of memory
+    int from = std::max(0, first - (max_span - 1));
+    int to = std::min(static_cast<int>(last), memory_size - 1);
+    for (int addr = from; addr <= to; addr++) {
+        entries[addr].kind = Undecoded;
+    }
+    if (first == 0 || last >= memory_size - 1) {
+        entries[memory_size - 1].kind = Undecoded;
+    }
+
+    // the part of a write that wrapped round to the start of memory
+    for (int addr = 0; addr <= last - memory_size; addr++) {
+        entries[addr].kind = Undecoded;
+    }
+}
+
+void DecodeCache::clear() {
+
+    Entry undecoded = {};
+    undecoded.kind = Undecoded;
+    std::fill(entries.begin(), entries.end(), undecoded);
+}
+
+void DecodeCache::decode(const Byte* memory, DoubleByte pc, Entry& entry) const {
+
+    // opcodes are big endian; the first wraps round the end of memory like
+    // the interpreter's fetch, fused sequences never do
+    DoubleByte ops[3] = { 0, 0, 0 };
+    ops[0] = (memory[pc] << 8) | memory[(pc + 1) & (memory_size - 1)];
+    int count = 1;
+    for (int addr = pc + 2; count < 3 && addr + 1 < memory_size; addr += 2) {
+        ops[count++] = (memory[addr] << 8) | memory[addr + 1];
+    }
+
+    DoubleByte op = ops[0];
+    entry.kind = single_kind(op);
+    entry.opcode = op;
+    entry.X = (op & 0x0F00) >> 8;
+    entry.Y = (op & 0x00F0) >> 4;
+    entry.N = op & 0x000F;
+    entry.NN = op & 0x00FF;
+    entry.NN2 = 0;
+    entry.NNN = op & 0x0FFF;
+
+    if (!fuse) {
+        return;
+    }
+
+    if (count == 3 && (ops[2] & 0xF000) == 0x1000
+            && (ops[1] & 0xFF00) == (0x3000 | (entry.X << 8))) {
+
+        if ((op & 0xF0FF) == 0xF007 && (ops[1] & 0x00FF) == 0x00) {
+            entry.kind = WaitTimer;
+            entry.NNN = ops[2] & 0x0FFF;
+            return;
+        }
+        if ((op & 0xF000) == 0x7000) {
+            entry.kind = CountLoop;
+            entry.NN2 = ops[1] & 0x00FF;
+            entry.NNN = ops[2] & 0x0FFF;
+            return;
+        }
+    }
+
+    if (count >= 2) {
+
+        if ((op & 0xF000) == 0xA000 && (ops[1] & 0xF000) == 0xD000) {
+            entry.kind = LoadDraw;
+            entry.X = (ops[1] & 0x0F00) >> 8;
+            entry.Y = (ops[1] & 0x00F0) >> 4;
+            entry.N = ops[1] & 0x000F;
+            return;
+        }
+        if ((op & 0xF000) == 0x6000 && (ops[1] & 0xF000) == 0x6000) {
+            entry.kind = LoadLoad;
+            entry.Y = (ops[1] & 0x0F00) >> 8;
+            entry.NN2 = ops[1] & 0x00FF;
+            return;
+        }
+    }
+}
@@ -1,10 +1,13 @@
 #include <stdexcept>
+#include <algorithm>
 #include "display.h"
 
-std::unique_ptr<SDL_Window, void(*)(SDL_Window*)> make_window(const char *title, int x, int y, int w, int h, Uint32 flags);
-std::unique_ptr<SDL_Renderer, void(*)(SDL_Renderer*)> make_renderer(SDL_Window* pw);
+static std::uint32_t argb(const SDL_Color& c) {
+    return (c.a << 24) | (c.r << 16) | (c.g << 8) | c.b;
+}
 
-Display::Display() {
+Display::Display(const DisplayOptions& options):
+    options(options), scaler(options.filter, argb(foreground_color), argb(background_color)) {
     init();
     clear();
 
@@ -25,25 +28,40 @@ void Display::clear() {
 
 void Display::draw(Byte buffer[]) {
 
-    clear();
     SDL_Renderer *pRenderer = renderer.get();
-    for(int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
-
-        if (buffer[i] != 0x00) {
 
-            int x = i % SCREEN_WIDTH;
-            int y = i / SCREEN_WIDTH;
-
-            SDL_Rect fillRect = { x*pixel_scale, y*pixel_scale, pixel_scale, pixel_scale };
-            SDL_SetRenderDrawColor(pRenderer, foreground_color.r, foreground_color.g, foreground_color.b, foreground_color.a);
-            SDL_RenderFillRect(pRenderer, &fillRect);
-        }
+    // upload only the rows the scaler rewrote
+    int first, last;
+    if (scaler.update(buffer, first, last)) {
+        SDL_Rect rows = { 0, first, scaler.width(), last - first + 1 };
+        SDL_UpdateTexture(texture.get(), &rows, scaler.pixels() + first * scaler.width(), scaler.pitch());
     }
+
+    SDL_SetRenderDrawColor(pRenderer, background_color.r, background_color.g, background_color.b, background_color.a);
+    SDL_RenderClear(pRenderer);
+    SDL_Rect target = target_rect();
+    SDL_RenderCopy(pRenderer, texture.get(), nullptr, &target);
     //Update screen
     SDL_RenderPresent(pRenderer);
 
 }
 
+SDL_Rect Display::target_rect() {
+
+    int w, h;
+    SDL_GetRendererOutputSize(renderer.get(), &w, &h);
+
+    double scale = std::min(static_cast<double>(w) / scaler.width(), static_cast<double>(h) / scaler.height());
+    if (options.integer_scaling && scale >= 1.0) {
+        scale = static_cast<int>(scale);
+    }
+
+    int target_w = static_cast<int>(scaler.width() * scale);
+    int target_h = static_cast<int>(scaler.height() * scale);
+    SDL_Rect target = { (w - target_w) / 2, (h - target_h) / 2, target_w, target_h };
+    return target;
+}
+
 
 bool Display::init() {
 
@@ -52,8 +70,19 @@ bool Display::init() {
         printf( "SDL could not initialize! SDL_Error: %s\n", SDL_GetError() );
         success = false;
     } else {
-        window = make_window("SDL Tutorial", 0, 0, SCREEN_WIDTH * pixel_scale, SCREEN_HEIGHT * pixel_scale, SDL_WINDOW_SHOWN);
+        int window_width = options.window_width;
+        int window_height = options.window_height;
+        if (window_width <= 0 || window_height <= 0) {
+            // so that integer scaling fills the window whatever the filter
+            int multiple = (SCREEN_WIDTH * default_window_scale + scaler.width() - 1) / scaler.width();
+            window_width = scaler.width() * multiple;
+            window_height = scaler.height() * multiple;
+        }
+        window = make_window("chip8", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, window_width, window_height, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
         renderer = make_renderer(window.get());
+        // the filters do the smoothing, stretch the texture with nearest neighbour
+        SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+        texture = make_texture(renderer.get(), scaler.width(), scaler.height());
     }
     return success;
 }
@@ -78,7 +107,7 @@ std::unique_ptr<SDL_Window, void(*)(SDL_Window*)> make_window(const char *title,
 std::unique_ptr<SDL_Renderer, void(*)(SDL_Renderer*)> make_renderer(SDL_Window* pw) {
 
     SDL_Renderer *pr = SDL_CreateRenderer(pw, -1, SDL_RENDERER_ACCELERATED);
-    if (!pw) {
+    if (!pr) {
         char msg[100];
         sprintf(msg, "Renderer could not be created! SDL_Error: %s\n", SDL_GetError());
         throw std::runtime_error(msg);
@@ -86,3 +115,15 @@ std::unique_ptr<SDL_Renderer, void(*)(SDL_Renderer*)> make_renderer(SDL_Window*
 
     return std::unique_ptr<SDL_Renderer, void(*)(SDL_Renderer*)>(pr, SDL_DestroyRenderer);
 }
+
+std::unique_ptr<SDL_Texture, void(*)(SDL_Texture*)> make_texture(SDL_Renderer* pr, int w, int h) {
+
+    SDL_Texture *pt = SDL_CreateTexture(pr, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, w, h);
+    if (!pt) {
+        char msg[100];
+        sprintf(msg, "Texture could not be created! SDL_Error: %s\n", SDL_GetError());
+        throw std::runtime_error(msg);
+    }
+
+    return std::unique_ptr<SDL_Texture, void(*)(SDL_Texture*)>(pt, SDL_DestroyTexture);
+}
@@ -0,0 +1,380 @@
+#include "explorer.h"
+#include "machine_pool.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <unordered_set>
+
+namespace {
+
+// Hashes of every state reached so far, sharded to keep lock contention low.
+class VisitedSet {
+
+public:
+    bool insert(std::uint64_t hash) {
+        Shard& shard = shards[hash % num_shards];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.hashes.insert(hash).second;
+    }
+
+private:
+    static const int num_shards = 64;
+
+    struct Shard {
+        std::mutex mutex;
+        std::unordered_set<std::uint64_t> hashes;
+    };
+    Shard shards[num_shards];
+};
+
+struct Counters {
+    long expanded;
+    long duplicates;
+    long failed;
+};
+
+// Holds the action's key for its cycles. Returns false if the machine hit
+// an invalid instruction.
+bool apply(Chip8& machine, int action, int cycles) {
+
+    std::bitset<Chip8::num_keys> keys;
+    if (action > 0) {
+        keys.set(action - 1);
+    }
+    machine.set_keys(keys);
+
+    try {
+        for (int c = 0; c < cycles; c++) {
+            for (int i = 0; i < Chip8::INSTRUCTIONS_PER_CYCLE; i++) {
+                machine.step();
+            }
+            machine.update_timers();
+        }
+    } catch (const std::exception&) {
+        return false;
+    }
+    return true;
+}
+
+// Runs body(0) to body(threads - 1) in parallel. Index t is always pinned
+// to the same NUMA node, so pools it creates stay local to it on later
+// calls. With more than one thread, index 0 runs on a new thread too, so
+// the caller is never pinned.
+void parallel_for(int threads, const std::function<void(int)>& body) {
+
+    if (threads == 1) {
+        body(0);
+        return;
+    }
+
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.push_back(std::thread([&body, t, threads] {
+            pin_to_numa_node(t, threads);
+            body(t);
+        }));
+    }
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+}
+
+Explorer::Explorer(const Chip8& start, Objective objective, const ExplorerOptions& options):
+    start(start), objective(objective), options(options) {
+
+    thread_count = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    thread_count = std::max(1, thread_count);
+}
+
+ExplorerResult Explorer::run() {
+
+    typedef std::chrono::steady_clock clock;
+    clock::time_point begin = clock::now();
+
+    ExplorerResult result = options.algorithm == ExplorerOptions::Algorithm::Beam ? run_beam() : run_mcts();
+
+    result.seconds = std::chrono::duration<double>(clock::now() - begin).count();
+    return result;
+}
+
+ExplorerResult Explorer::run_beam() {
+
+    struct Node {
+        const Chip8* state;
+        double score;
+        int parent;
+        int action;
+    };
+
+    // Children of one level are written into one generation of pools while
+    // the frontier they came from lives in the other.
+    int max_children = options.beam_width * num_actions;
+    int share = (max_children + thread_count - 1) / thread_count;
+    std::vector<std::unique_ptr<MachinePool> > pools[2];
+    pools[0].resize(thread_count);
+    pools[1].resize(thread_count);
+    parallel_for(thread_count, [&](int t) {
+        pools[0][t].reset(new MachinePool(share, start));
+        pools[1][t].reset(new MachinePool(share, start));
+    });
+
+    VisitedSet visited;
+    visited.insert(start.state_hash());
+
+    std::vector<Node> frontier(1, Node{ &start, objective(start), -1, 0 });
+    // (parent, action) of every node kept at each level, to rebuild paths
+    std::vector<std::vector<Node> > history;
+    std::vector<Counters> counters(thread_count, Counters{ 0, 0, 0 });
+
+    ExplorerResult result = ExplorerResult();
+    result.best_score = frontier[0].score;
+    int best_level = -1;
+
+    for (int level = 0; level < options.depth && !frontier.empty(); level++) {
+
+        std::vector<std::unique_ptr<MachinePool> >& generation = pools[level % 2];
+        for (std::unique_ptr<MachinePool>& pool : generation) {
+            pool->release_all();
+        }
+
+        int count = static_cast<int>(frontier.size()) * num_actions;
+        std::vector<Node> children(count, Node{ nullptr, 0.0, 0, 0 });
+
+        parallel_for(thread_count, [&](int t) {
+            MachinePool& pool = *generation[t];
+            Counters& counter = counters[t];
+
+            for (int i = count * t / thread_count; i < count * (t + 1) / thread_count; i++) {
+
+                int parent = i / num_actions;
+                int action = i % num_actions;
+                Chip8* child = pool.fork(*frontier[parent].state);
+
+                if (!apply(*child, action, options.cycles_per_action)) {
+                    pool.release(child);
+                    counter.failed++;
+                } else if (!visited.insert(child->state_hash())) {
+                    pool.release(child);
+                    counter.duplicates++;
+                } else {
+                    children[i] = Node{ child, objective(*child), parent, action };
+                    counter.expanded++;
+                }
+            }
+        });
+
+        children.erase(std::remove_if(children.begin(), children.end(),
+                                      [](const Node& node) { return node.state == nullptr; }),
+                       children.end());
+
+        auto by_score = [](const Node& a, const Node& b) { return a.score > b.score; };
+        if (static_cast<int>(children.size()) > options.beam_width) {
+            std::nth_element(children.begin(), children.begin() + options.beam_width, children.end(), by_score);
+            children.resize(options.beam_width);
+        }
+        std::sort(children.begin(), children.end(), by_score);
+
+        if (!children.empty() && children[0].score > result.best_score) {
+            result.best_score = children[0].score;
+            best_level = level;
+        }
+
+        history.push_back(children);
+        frontier.swap(children);
+    }
+
+    // the best node of a level is always first after sorting
+    for (int level = best_level, index = 0; level >= 0; level--) {
+        const Node& node = history[level][index];
+        result.actions.push_back(node.action - 1);
+        index = node.parent;
+    }
+    std::reverse(result.actions.begin(), result.actions.end());
+
+    for (const Counters& counter : counters) {
+        result.expanded += counter.expanded;
+        result.duplicates += counter.duplicates;
+        result.failed += counter.failed;
+    }
+    return result;
+}
+
+ExplorerResult Explorer::run_mcts() {
+
+    // Root parallel UCT: every thread grows its own tree from the start
+    // state, independently, and the best path over all trees wins. The
+    // visited set is per tree too; shared, a state one tree reached would
+    // be pruned from every other and the trees would split the state space
+    // at random instead of each searching it. Tree nodes keep statistics,
+    // not machines; a state is rebuilt by replaying its path from the start.
+    static const int unexpanded = -1;
+    static const int pruned = -2;
+
+    struct TreeNode {
+        int children[num_actions];
+        int visits;
+        double total;
+    };
+
+    struct ThreadResult {
+        double best_score;
+        std::vector<int> best_actions;
+    };
+
+    std::vector<Counters> counters(thread_count, Counters{ 0, 0, 0 });
+    std::vector<ThreadResult> results(thread_count);
+    double start_score = objective(start);
+
+    parallel_for(thread_count, [&](int t) {
+
+        Counters& counter = counters[t];
+        ThreadResult& best = results[t];
+        best.best_score = start_score;
+
+        std::unordered_set<std::uint64_t> visited;
+        visited.insert(start.state_hash());
+
+        std::uint32_t rng = options.seed * 2654435761u + t + 1;
+        auto random_action = [&rng]() {
+            return static_cast<int>((static_cast<std::uint32_t>(next_random(rng)) * num_actions) >> 8);
+        };
+
+        TreeNode root = TreeNode();
+        std::fill(std::begin(root.children), std::end(root.children), unexpanded);
+        std::vector<TreeNode> tree(1, root);
+
+        double min_score = start_score;
+        double max_score = start_score;
+        long iterations = options.iterations / thread_count + (t < options.iterations % thread_count);
+
+        std::vector<int> path;
+        std::vector<int> actions;
+
+        for (long iteration = 0; iteration < iterations; iteration++) {
+
+            Chip8 state(start);
+            path.assign(1, 0);
+            actions.clear();
+
+            // selection: descend through fully expanded nodes by UCT
+            while (static_cast<int>(actions.size()) < options.depth) {
+
+                TreeNode& node = tree[path.back()];
+                if (std::find(std::begin(node.children), std::end(node.children), unexpanded) != std::end(node.children)) {
+                    break;
+                }
+
+                int choice = -1;
+                double best_uct = -std::numeric_limits<double>::infinity();
+                double range = max_score > min_score ? max_score - min_score : 1.0;
+                for (int a = 0; a < num_actions; a++) {
+                    if (node.children[a] == pruned) {
+                        continue;
+                    }
+                    const TreeNode& child = tree[node.children[a]];
+                    double mean = (child.total / child.visits - min_score) / range;
+                    double uct = mean + options.exploration * std::sqrt(std::log(node.visits) / child.visits);
+                    if (uct > best_uct) {
+                        best_uct = uct;
+                        choice = a;
+                    }
+                }
+                if (choice < 0) {
+                    break;
+                }
+
+                apply(state, choice, options.cycles_per_action);
+                path.push_back(tree[path.back()].children[choice]);
+                actions.push_back(choice);
+            }
+
+            // expansion: try one unexpanded action of the leaf
+            if (static_cast<int>(actions.size()) < options.depth) {
+
+                std::vector<int> open;
+                for (int a = 0; a < num_actions; a++) {
+                    if (tree[path.back()].children[a] == unexpanded) {
+                        open.push_back(a);
+                    }
+                }
+
+                if (!open.empty()) {
+                    int action = open[(static_cast<std::uint32_t>(next_random(rng)) * open.size()) >> 8];
+
+                    if (!apply(state, action, options.cycles_per_action)) {
+                        tree[path.back()].children[action] = pruned;
+                        counter.failed++;
+                        continue;
+                    }
+                    if (!visited.insert(state.state_hash()).second) {
+                        tree[path.back()].children[action] = pruned;
+                        counter.duplicates++;
+                        continue;
+                    }
+
+                    TreeNode child = TreeNode();
+                    std::fill(std::begin(child.children), std::end(child.children), unexpanded);
+                    tree.push_back(child);
+                    int index = static_cast<int>(tree.size()) - 1;
+                    tree[path.back()].children[action] = index;
+                    path.push_back(index);
+                    actions.push_back(action);
+                    counter.expanded++;
+
+                    double score = objective(state);
+                    if (score > best.best_score) {
+                        best.best_score = score;
+                        best.best_actions = actions;
+                    }
+                }
+            }
+
+            // rollout: random keys to the depth limit
+            std::size_t tree_actions = actions.size();
+            while (static_cast<int>(actions.size()) < options.depth) {
+                int action = random_action();
+                if (!apply(state, action, options.cycles_per_action)) {
+                    break;
+                }
+                actions.push_back(action);
+            }
+
+            double score = objective(state);
+            min_score = std::min(min_score, score);
+            max_score = std::max(max_score, score);
+            if (score > best.best_score) {
+                best.best_score = score;
+                best.best_actions = actions;
+            }
+            actions.resize(tree_actions);
+
+            for (int index : path) {
+                tree[index].visits++;
+                tree[index].total += score;
+            }
+        }
+    });
+
+    ExplorerResult result = ExplorerResult();
+    result.best_score = start_score;
+    for (int t = 0; t < thread_count; t++) {
+        result.expanded += counters[t].expanded;
+        result.duplicates += counters[t].duplicates;
+        result.failed += counters[t].failed;
+        if (results[t].best_score > result.best_score) {
+            result.best_score = results[t].best_score;
+            result.actions.clear();
+            for (int action : results[t].best_actions) {
+                result.actions.push_back(action - 1);
+            }
+        }
+    }
+    return result;
+}
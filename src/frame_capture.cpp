@@ -0,0 +1,205 @@
+#include "frame_capture.h"
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+// Hash of a screen, eight pixels at a time.
+static std::uint64_t frame_hash(const Byte* screen, int size) {
+
+    std::uint64_t h = 0xCBF29CE484222325ULL;
+    for (int i = 0; i < size; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, screen + i, sizeof(word));
+        h = (h ^ word) * 0x100000001B3ULL;
+        h ^= h >> 29;
+    }
+    return h;
+}
+
+FrameCapture::FrameCapture(const FrameCaptureOptions& options): options(options) {
+
+    int thread_count = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    thread_count = std::max(1, thread_count);
+    int buffer_count = std::max(options.buffers, thread_count);
+
+    buffers.reset(new Byte[static_cast<std::size_t>(buffer_count) * frame_size]);
+    for (int t = 0; t < thread_count; t++) {
+        Encoder* encoder = new Encoder();
+        encoder->stopping = false;
+        for (int b = buffer_count * t / thread_count; b < buffer_count * (t + 1) / thread_count; b++) {
+            encoder->free_buffers.push_back(&buffers[static_cast<std::size_t>(b) * frame_size]);
+        }
+        encoders.push_back(std::unique_ptr<Encoder>(encoder));
+    }
+    for (std::unique_ptr<Encoder>& encoder : encoders) {
+        encoder->thread = std::thread(&FrameCapture::encode, this, std::ref(*encoder));
+    }
+}
+
+FrameCapture::~FrameCapture() {
+
+    for (std::unique_ptr<Encoder>& encoder : encoders) {
+        {
+            std::lock_guard<std::mutex> lock(encoder->mutex);
+            encoder->stopping = true;
+        }
+        encoder->ready.notify_one();
+    }
+    for (std::unique_ptr<Encoder>& encoder : encoders) {
+        encoder->thread.join();
+    }
+    for (std::unique_ptr<CaptureStream>& stream : streams) {
+        finish(*stream);
+    }
+}
+
+CaptureStream& FrameCapture::open_stream(const std::string& path) {
+
+    std::lock_guard<std::mutex> lock(streams_mutex);
+    int encoder = static_cast<int>(streams.size() % encoders.size());
+    streams.push_back(std::unique_ptr<CaptureStream>(new CaptureStream(path, encoder)));
+    return *streams.back();
+}
+
+bool FrameCapture::submit(CaptureStream& stream, const Byte* screen) {
+
+    long frame = stream.frames++;
+    if (stream.dropped > 0) {
+        // the stream ended at its first dropped frame
+        stream.dropped++;
+        return false;
+    }
+    std::uint64_t hash = frame_hash(screen, frame_size);
+    if (frame > 0 && hash == stream.last_hash) {
+        stream.duplicates++;
+        return true;
+    }
+
+    Encoder& encoder = *encoders[stream.encoder];
+    bool was_idle;
+    {
+        std::unique_lock<std::mutex> lock(encoder.mutex);
+        if (options.wait_for_buffers) {
+            encoder.freed.wait(lock, [&encoder] { return !encoder.free_buffers.empty(); });
+        } else if (encoder.free_buffers.empty()) {
+            // the encoders are behind
+            stream.dropped++;
+            return false;
+        }
+        Byte* buffer = encoder.free_buffers.back();
+        encoder.free_buffers.pop_back();
+        std::memcpy(buffer, screen, frame_size);
+
+        was_idle = encoder.jobs.empty();
+        encoder.jobs.push_back(Job{ &stream, frame, buffer });
+    }
+    if (was_idle) {
+        encoder.ready.notify_one();
+    }
+
+    stream.last_hash = hash;
+    return true;
+}
+
+CaptureStats FrameCapture::stats() {
+
+    std::lock_guard<std::mutex> lock(streams_mutex);
+    CaptureStats totals = { 0, 0, 0 };
+    for (std::unique_ptr<CaptureStream>& stream : streams) {
+        totals.frames += stream->frames;
+        totals.duplicates += stream->duplicates;
+        totals.dropped += stream->dropped;
+    }
+    return totals;
+}
+
+void FrameCapture::encode(Encoder& encoder) {
+
+    std::vector<Job> batch;
+
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(encoder.mutex);
+            for (const Job& job : batch) {
+                encoder.free_buffers.push_back(job.buffer);
+            }
+            if (!batch.empty()) {
+                encoder.freed.notify_all();
+            }
+            batch.clear();
+
+            encoder.ready.wait(lock, [&encoder] { return encoder.stopping || !encoder.jobs.empty(); });
+            if (encoder.jobs.empty()) {
+                return;
+            }
+            batch.swap(encoder.jobs);
+        }
+
+        for (const Job& job : batch) {
+            write(*job.stream, job.frame, job.buffer);
+        }
+    }
+}
+
+void FrameCapture::write(CaptureStream& stream, long frame, const Byte* screen) {
+
+    if (options.format == CaptureFormat::Pbm) {
+        // lit pixels white; in PBM a set bit is black
+        std::ostringstream name;
+        name << stream.path << "_" << std::setw(6) << std::setfill('0') << frame << ".pbm";
+        std::ofstream out(name.str(), std::ios::binary);
+        if (!out) {
+            std::cerr << "Could not open " << name.str() << std::endl;
+            return;
+        }
+
+        out << "P4\n" << SCREEN_WIDTH << " " << SCREEN_HEIGHT << "\n";
+        Byte packed[SCREEN_WIDTH * SCREEN_HEIGHT / 8];
+        for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT / 8; i++) {
+            Byte bits = 0;
+            for (int b = 0; b < 8; b++) {
+                bits = static_cast<Byte>(bits << 1) | (screen[8 * i + b] ? 0 : 1);
+            }
+            packed[i] = bits;
+        }
+        out.write(reinterpret_cast<const char*>(packed), sizeof(packed));
+        return;
+    }
+
+    if (!stream.out.is_open()) {
+        stream.out.open(stream.path + ".y4m", std::ios::binary);
+        if (!stream.out) {
+            std::cerr << "Could not open " << stream.path << ".y4m" << std::endl;
+        }
+        stream.out << "YUV4MPEG2 W" << SCREEN_WIDTH << " H" << SCREEN_HEIGHT << " F" << options.frame_rate
+                   << ":1 Ip A1:1 Cmono XCOLORRANGE=FULL\n";
+    }
+
+    // frames skipped as duplicates since the last one written repeat it
+    for (; stream.written < frame; stream.written++) {
+        stream.out << "FRAME\n";
+        stream.out.write(reinterpret_cast<const char*>(stream.last), frame_size);
+    }
+
+    for (int i = 0; i < frame_size; i++) {
+        stream.last[i] = screen[i] ? 0xFF : 0x00;
+    }
+    stream.out << "FRAME\n";
+    stream.out.write(reinterpret_cast<const char*>(stream.last), frame_size);
+    stream.written++;
+}
+
+void FrameCapture::finish(CaptureStream& stream) {
+
+    if (options.format == CaptureFormat::Y4m && stream.out.is_open()) {
+        // up to the first dropped frame, if any; every drop comes after it
+        long end = stream.frames - stream.dropped;
+        for (; stream.written < end; stream.written++) {
+            stream.out << "FRAME\n";
+            stream.out.write(reinterpret_cast<const char*>(stream.last), frame_size);
+        }
+        stream.out.close();
+    }
+}
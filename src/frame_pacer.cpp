@@ -0,0 +1,116 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <iomanip>
+#include <thread>
+
+FramePacer::FramePacer(std::chrono::milliseconds cycle_period): cycle_period(cycle_period),
+    refresh_period(std::chrono::microseconds(1000000 / REFRESH_RATE)), next_cycle(clock::now()),
+    pending(false), render_cost(clock::duration::zero()), counts{ 0, 0, 0, 0, 0, 0.0 },
+    frame_times(histogram_size, 0) {
+
+}
+
+int FramePacer::cycles_due() {
+
+    clock::time_point now = clock::now();
+    int due = 0;
+    while (next_cycle <= now && due < MAX_CATCH_UP_CYCLES) {
+        next_cycle += cycle_period;
+        due++;
+    }
+    if (next_cycle <= now) {
+        // too far behind, drop the backlog rather than spiral
+        counts.lost_cycles += (now - next_cycle) / cycle_period + 1;
+        next_cycle = now + cycle_period;
+    }
+    return due;
+}
+
+void FramePacer::frame_ready() {
+
+    counts.frames++;
+    if (pending) {
+        counts.dropped++;
+    }
+    pending = true;
+}
+
+bool FramePacer::should_present() const {
+
+    if (!pending) {
+        return false;
+    }
+    if (counts.presented == 0) {
+        return true;
+    }
+
+    // leave at least a quarter of the time to emulation; this is only
+    // asked once a cycle, so half a cycle early is close enough
+    clock::duration interval = std::max(refresh_period, render_cost * 4 / 3);
+    return clock::now() - last_present_start + cycle_period / 2 >= interval;
+}
+
+void FramePacer::begin_present() {
+
+    present_start = clock::now();
+}
+
+void FramePacer::end_present() {
+
+    clock::time_point now = clock::now();
+    clock::duration cost = now - present_start;
+    render_cost = counts.presented == 0 ? cost : (render_cost * 7 + cost) / 8;
+
+    if (counts.presented > 0) {
+        long ms = static_cast<long>(std::chrono::duration_cast<std::chrono::milliseconds>(now - last_present).count());
+        frame_times[std::min<long>(ms, histogram_size - 1)]++;
+    }
+    if (now > next_cycle) {
+        counts.late++;
+    }
+
+    counts.presented++;
+    last_present_start = present_start;
+    last_present = now;
+    pending = false;
+}
+
+void FramePacer::wait() {
+
+    std::this_thread::sleep_until(next_cycle);
+}
+
+FramePacerStats FramePacer::stats() const {
+
+    FramePacerStats s = counts;
+    s.render_ms = std::chrono::duration<double, std::milli>(render_cost).count();
+    return s;
+}
+
+double FramePacer::frame_time_percentile(double fraction) const {
+
+    long total = 0;
+    for (long n : frame_times) {
+        total += n;
+    }
+    long seen = 0;
+    for (int ms = 0; ms < histogram_size; ms++) {
+        seen += frame_times[ms];
+        if (seen > 0 && seen >= fraction * total) {
+            return ms;
+        }
+    }
+    return 0;
+}
+
+void FramePacer::report(std::ostream& out) const {
+
+    FramePacerStats s = stats();
+    out << s.frames << " frames drawn, " << s.presented << " presented, " << s.dropped << " dropped, "
+        << s.late << " late, " << s.lost_cycles << " timer cycles lost" << std::endl
+        << std::fixed << std::setprecision(2) << "render " << s.render_ms << "ms, frame time"
+        << std::setprecision(0) << " p50 " << frame_time_percentile(0.5) << "ms"
+        << " p90 " << frame_time_percentile(0.9) << "ms"
+        << " p99 " << frame_time_percentile(0.99) << "ms"
+        << " max " << frame_time_percentile(1.0) << "ms" << std::endl;
+}
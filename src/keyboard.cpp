@@ -24,7 +24,7 @@ Keyboard::Keyboard() {
 
 }
 
-void Keyboard::read_key(std::bitset<16>& keys) {
+bool Keyboard::read_key(std::bitset<16>& keys) {
 
     SDL_Event event;
     while(SDL_PollEvent(&event)) {
@@ -32,8 +32,7 @@ void Keyboard::read_key(std::bitset<16>& keys) {
         SDL_Keycode key = event.key.keysym.sym;
 
         if (event.type == SDL_QUIT) {
-            SDL_Quit();
-            std::exit(0);
+            return false;
         }
 
         if (event.type == SDL_KEYDOWN) {
@@ -49,4 +48,5 @@ void Keyboard::read_key(std::bitset<16>& keys) {
             }
         }
     }
+    return true;
 }
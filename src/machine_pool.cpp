@@ -0,0 +1,177 @@
+#include "machine_pool.h"
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <type_traits>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static_assert(std::is_trivially_copyable<Chip8>::value, "Chip8 must be trivially copyable to be pooled");
+static_assert(sizeof(Chip8) % 64 == 0, "Chip8 slots must be whole cache lines");
+
+MachinePool::MachinePool(std::size_t capacity, const Chip8& rom_template): slot_count(capacity) {
+
+    std::size_t size = sizeof(Chip8) * (capacity + 1);
+    std::size_t space = size + alignof(Chip8);
+    arena.reset(new unsigned char[space]);
+
+    void* base = arena.get();
+    base = std::align(alignof(Chip8), size, base, space);
+    slots = static_cast<Chip8*>(base);
+
+    free_slots.reserve(capacity);
+    new (slots) Chip8(rom_template);
+    for (std::size_t i = capacity; i > 0; i--) {
+        new (slots + i) Chip8(rom_template);
+        free_slots.push_back(slots + i);
+    }
+}
+
+Chip8* MachinePool::acquire() {
+
+    if (free_slots.empty()) {
+        return nullptr;
+    }
+
+    Chip8* machine = free_slots.back();
+    free_slots.pop_back();
+    reset(machine);
+    return machine;
+}
+
+Chip8* MachinePool::fork(const Chip8& parent) {
+
+    if (free_slots.empty()) {
+        return nullptr;
+    }
+
+    Chip8* machine = free_slots.back();
+    free_slots.pop_back();
+    std::memcpy(static_cast<void*>(machine), &parent, sizeof(Chip8));
+    return machine;
+}
+
+void MachinePool::release(Chip8* machine) {
+    free_slots.push_back(machine);
+}
+
+void MachinePool::release_all() {
+
+    free_slots.clear();
+    for (std::size_t i = slot_count; i > 0; i--) {
+        free_slots.push_back(slots + i);
+    }
+}
+
+void MachinePool::reset(Chip8* machine) const {
+    std::memcpy(static_cast<void*>(machine), slots, sizeof(Chip8));
+}
+
+// Reads a sysfs list such as "0-3,8-11"; empty if the file is missing.
+static std::vector<int> read_sysfs_list(const std::string& path) {
+
+    std::vector<int> values;
+    std::ifstream in(path);
+    std::string line;
+    if (!std::getline(in, line)) {
+        return values;
+    }
+
+    std::istringstream ranges(line);
+    std::string range;
+    while (std::getline(ranges, range, ',')) {
+        if (range.empty()) {
+            continue;
+        }
+        std::size_t dash = range.find('-');
+        int low = std::atoi(range.c_str());
+        int high = dash == std::string::npos ? low : std::atoi(range.c_str() + dash + 1);
+        for (int value = low; value <= high; value++) {
+            values.push_back(value);
+        }
+    }
+    return values;
+}
+
+// CPUs of each online node that has any, read once.
+static const std::vector<std::vector<int> >& numa_nodes() {
+
+    static const std::vector<std::vector<int> > nodes = [] {
+        const std::string root = "/sys/devices/system/node/";
+        std::vector<std::vector<int> > found;
+        for (int node : read_sysfs_list(root + "online")) {
+            std::vector<int> cpus = read_sysfs_list(root + "node" + std::to_string(node) + "/cpulist");
+            if (!cpus.empty()) {
+                found.push_back(cpus);
+            }
+        }
+        return found;
+    }();
+    return nodes;
+}
+
+bool pin_to_numa_node(int worker, int worker_count) {
+
+#ifdef __linux__
+    const std::vector<std::vector<int> >& nodes = numa_nodes();
+    if (nodes.size() < 2 || worker_count < 1) {
+        return false;
+    }
+
+    const std::vector<int>& cpus = nodes[static_cast<std::size_t>(worker) * nodes.size() / worker_count];
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus) {
+        if (cpu < CPU_SETSIZE) {
+            CPU_SET(cpu, &set);
+        }
+    }
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+    (void)worker;
+    (void)worker_count;
+    return false;
+#endif
+}
+
+bool RunningMachine::run_cycle() {
+
+    if (halted) {
+        return false;
+    }
+    try {
+        return machine->run_cycle(cache, carry);
+    } catch (const std::exception&) {
+        halted = true;
+        return true;
+    }
+}
+
+MachineGroup::MachineGroup(const std::vector<std::string>& programs, int first, int last):
+    first_instance(first), pools(programs.size()) {
+
+    for (std::size_t p = 0; p < programs.size(); p++) {
+        int count = 0;
+        for (int i = first; i < last; i++) {
+            count += static_cast<std::size_t>(i) % programs.size() == p;
+        }
+        if (count > 0) {
+            Chip8 rom_template;
+            rom_template.load_program(programs[p]);
+            pools[p].reset(new MachinePool(count, rom_template));
+        }
+    }
+
+    for (int i = first; i < last; i++) {
+        RunningMachine* running = new RunningMachine();
+        running->machine = pools[i % programs.size()]->acquire();
+        running->carry = 0;
+        running->halted = false;
+        machines.push_back(std::unique_ptr<RunningMachine>(running));
+    }
+}
@@ -1,17 +1,140 @@
 #include "chip8.h"
+#include "debugger.h"
+#include "trace.h"
+#include "aot_runtime.h"
+#include "display.h"
+#include "video_wall.h"
+#include <cstring>
+#include <cstdlib>
+#include <cstdio>
 
-int main(int argc, char* argv[])
-{
-    if (argc != 2) {
-        std::cerr << "Usage: chip8 filename" << std::endl;
-        std::exit(0);
+static void usage() {
+    std::cerr << "Usage: chip8 [--debug | --trace file | --aot module.so [--validate instructions]]" << std::endl
+              << "             [--filter nearest|scale2x|scale3x|scale4x] [--size WIDTHxHEIGHT] [--stretch] filename" << std::endl
+              << "       chip8 --wall instances [--threads N] [--size WIDTHxHEIGHT] filename..." << std::endl;
+    std::exit(0);
+}
+
+static bool parse_filter(const char* name, ScaleFilter& filter) {
+
+    static const char* names[] = { "nearest", "scale2x", "scale3x", "scale4x" };
+    static const ScaleFilter filters[] = { ScaleFilter::Nearest, ScaleFilter::Scale2x, ScaleFilter::Scale3x, ScaleFilter::Scale4x };
+    for (int i = 0; i < 4; i++) {
+        if (std::strcmp(name, names[i]) == 0) {
+            filter = filters[i];
+            return true;
+        }
     }
+    return false;
+}
+
+static int validate(const AotPlugin& plugin, const std::string& program_name, long instructions) {
 
     Chip8 chip8;
-    chip8.run_application(argv[1]);
+    chip8.load_program(program_name);
 
+    AotReport report = aot_validate(chip8, plugin, instructions);
+    if (!report.error.empty()) {
+        std::cerr << "Stopped after " << report.instructions << " instructions: " << report.error << std::endl;
+        return 1;
+    }
+    if (!report.equivalent) {
+        std::cerr << "Diverged from the interpreter in block 0x" << std::hex << report.divergence_pc
+                  << std::dec << " after " << report.instructions << " instructions" << std::endl;
+        return 1;
+    }
+
+    std::cout << report.instructions << " instructions equivalent ("
+              << report.compiled_instructions << " compiled)" << std::endl
+              << "interpreter " << report.interpreter_ns / report.instructions << " ns/instruction, "
+              << "compiled " << report.compiled_ns / report.instructions << " ns/instruction, "
+              << "speedup " << report.interpreter_ns / report.compiled_ns << "x" << std::endl;
     return 0;
 }
 
+int main(int argc, char* argv[])
+{
+    bool debug = false;
+    const char* trace_file = nullptr;
+    const char* aot_module = nullptr;
+    long validate_instructions = 0;
+    DisplayOptions options;
+    VideoWallOptions wall_options;
+    bool wall = false;
 
+    int arg = 1;
+    for (; arg < argc && std::strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (std::strcmp(argv[arg], "--debug") == 0) {
+            debug = true;
+        } else if (std::strcmp(argv[arg], "--trace") == 0 && arg + 2 < argc) {
+            trace_file = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--wall") == 0 && arg + 2 < argc) {
+            wall = true;
+            wall_options.instances = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--threads") == 0 && arg + 2 < argc) {
+            wall_options.threads = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--aot") == 0 && arg + 2 < argc) {
+            aot_module = argv[++arg];
+        } else if (std::strcmp(argv[arg], "--validate") == 0 && arg + 2 < argc) {
+            validate_instructions = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--filter") == 0 && arg + 2 < argc) {
+            if (!parse_filter(argv[++arg], options.filter)) {
+                usage();
+            }
+        } else if (std::strcmp(argv[arg], "--size") == 0 && arg + 2 < argc) {
+            if (std::sscanf(argv[++arg], "%dx%d", &options.window_width, &options.window_height) != 2) {
+                usage();
+            }
+            wall_options.window_width = options.window_width;
+            wall_options.window_height = options.window_height;
+        } else if (std::strcmp(argv[arg], "--stretch") == 0) {
+            options.integer_scaling = false;
+        } else {
+            usage();
+        }
+    }
 
+    std::vector<std::string> programs(argv + arg, argv + argc);
+    if (programs.empty() || (debug && aot_module) || (validate_instructions && !aot_module)
+            || (trace_file && (debug || aot_module || wall))
+            || (wall && (debug || aot_module)) || (!wall && programs.size() != 1)) {
+        usage();
+    }
+
+    if (wall) {
+        VideoWall video_wall(programs, wall_options);
+        video_wall.run();
+        return 0;
+    }
+
+    const std::string& program_name = programs[0];
+
+    if (aot_module) {
+        AotPlugin plugin(aot_module);
+        if (validate_instructions) {
+            return validate(plugin, program_name, validate_instructions);
+        }
+        Chip8 chip8;
+        chip8.run_compiled(program_name, options, plugin);
+        return 0;
+    }
+
+    Chip8 chip8;
+    if (trace_file) {
+        TraceWriter writer(trace_file);
+        TraceHooks hooks(writer.open_buffer());
+        try {
+            chip8.run_application(program_name, options, hooks);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            return 1;
+        }
+    } else if (debug) {
+        Debugger debugger;
+        chip8.run_application(program_name, options, debugger);
+    } else {
+        chip8.run_application(program_name, options);
+    }
+
+    return 0;
+}
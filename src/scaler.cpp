@@ -0,0 +1,313 @@
+#include "scaler.h"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define SCALER_X86 1
+#include <immintrin.h>
+#endif
+
+// Row kernels work on 0/1 pixels. above and below are the neighbouring rows,
+// already clamped at the screen edges. Widths are multiples of 32.
+typedef void (*Scale2xRow)(const Byte* above, const Byte* row, const Byte* below, int w, Byte* out0, Byte* out1);
+typedef void (*ExpandRow)(const Byte* in, int w, std::uint32_t fg, std::uint32_t bg, std::uint32_t* out);
+
+static const int max_width = SCREEN_WIDTH * 2;
+
+// Copies row into padded[1..w] with the edge pixels repeated on either side,
+// so that padded + x and padded + x + 2 are the left and right neighbours.
+static void pad_row(const Byte* row, int w, Byte* padded) {
+    padded[0] = row[0];
+    std::memcpy(padded + 1, row, w);
+    padded[w + 1] = row[w - 1];
+}
+
+#ifndef SCALER_X86
+
+static void scale2x_row_scalar(const Byte* above, const Byte* row, const Byte* below, int w, Byte* out0, Byte* out1) {
+
+    Byte padded[max_width + 2];
+    pad_row(row, w, padded);
+
+    for (int x = 0; x < w; x++) {
+        Byte B = above[x], D = padded[x], E = padded[x + 1], F = padded[x + 2], H = below[x];
+        out0[2 * x]     = (D == B && B != F && D != H) ? D : E;
+        out0[2 * x + 1] = (B == F && B != D && F != H) ? F : E;
+        out1[2 * x]     = (D == H && D != B && H != F) ? D : E;
+        out1[2 * x + 1] = (H == F && D != H && B != F) ? F : E;
+    }
+}
+
+static void expand_row_scalar(const Byte* in, int w, std::uint32_t fg, std::uint32_t bg, std::uint32_t* out) {
+    for (int x = 0; x < w; x++) {
+        out[x] = in[x] ? fg : bg;
+    }
+}
+
+#else
+
+static void scale2x_row_sse2(const Byte* above, const Byte* row, const Byte* below, int w, Byte* out0, Byte* out1) {
+
+    Byte padded[max_width + 2];
+    pad_row(row, w, padded);
+
+    for (int x = 0; x < w; x += 16) {
+        __m128i B = _mm_loadu_si128(reinterpret_cast<const __m128i*>(above + x));
+        __m128i H = _mm_loadu_si128(reinterpret_cast<const __m128i*>(below + x));
+        __m128i D = _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + x));
+        __m128i E = _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + x + 1));
+        __m128i F = _mm_loadu_si128(reinterpret_cast<const __m128i*>(padded + x + 2));
+
+        __m128i DB = _mm_cmpeq_epi8(D, B);
+        __m128i BF = _mm_cmpeq_epi8(B, F);
+        __m128i DH = _mm_cmpeq_epi8(D, H);
+        __m128i HF = _mm_cmpeq_epi8(H, F);
+
+        // _mm_andnot_si128(a, b) is ~a & b
+        __m128i c0 = _mm_andnot_si128(DH, _mm_andnot_si128(BF, DB));
+        __m128i c1 = _mm_andnot_si128(HF, _mm_andnot_si128(DB, BF));
+        __m128i c2 = _mm_andnot_si128(HF, _mm_andnot_si128(DB, DH));
+        __m128i c3 = _mm_andnot_si128(BF, _mm_andnot_si128(DH, HF));
+
+        __m128i E0 = _mm_or_si128(_mm_and_si128(c0, D), _mm_andnot_si128(c0, E));
+        __m128i E1 = _mm_or_si128(_mm_and_si128(c1, F), _mm_andnot_si128(c1, E));
+        __m128i E2 = _mm_or_si128(_mm_and_si128(c2, D), _mm_andnot_si128(c2, E));
+        __m128i E3 = _mm_or_si128(_mm_and_si128(c3, F), _mm_andnot_si128(c3, E));
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x), _mm_unpacklo_epi8(E0, E1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out0 + 2 * x + 16), _mm_unpackhi_epi8(E0, E1));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x), _mm_unpacklo_epi8(E2, E3));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out1 + 2 * x + 16), _mm_unpackhi_epi8(E2, E3));
+    }
+}
+
+static void expand_row_sse2(const Byte* in, int w, std::uint32_t fg, std::uint32_t bg, std::uint32_t* out) {
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i fgv = _mm_set1_epi32(static_cast<int>(fg));
+    const __m128i bgv = _mm_set1_epi32(static_cast<int>(bg));
+
+    for (int x = 0; x < w; x += 16) {
+        // all ones where the pixel is off
+        __m128i m = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in + x)), zero);
+        __m128i m16[2] = { _mm_unpacklo_epi8(m, m), _mm_unpackhi_epi8(m, m) };
+
+        for (int i = 0; i < 4; i++) {
+            __m128i m32 = (i & 1) ? _mm_unpackhi_epi16(m16[i >> 1], m16[i >> 1])
+                                  : _mm_unpacklo_epi16(m16[i >> 1], m16[i >> 1]);
+            __m128i pixels = _mm_or_si128(_mm_and_si128(m32, bgv), _mm_andnot_si128(m32, fgv));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + x + 4 * i), pixels);
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void scale2x_row_avx2(const Byte* above, const Byte* row, const Byte* below, int w, Byte* out0, Byte* out1) {
+
+    Byte padded[max_width + 2];
+    pad_row(row, w, padded);
+
+    for (int x = 0; x < w; x += 32) {
+        __m256i B = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(above + x));
+        __m256i H = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(below + x));
+        __m256i D = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(padded + x));
+        __m256i E = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(padded + x + 1));
+        __m256i F = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(padded + x + 2));
+
+        __m256i DB = _mm256_cmpeq_epi8(D, B);
+        __m256i BF = _mm256_cmpeq_epi8(B, F);
+        __m256i DH = _mm256_cmpeq_epi8(D, H);
+        __m256i HF = _mm256_cmpeq_epi8(H, F);
+
+        __m256i c0 = _mm256_andnot_si256(DH, _mm256_andnot_si256(BF, DB));
+        __m256i c1 = _mm256_andnot_si256(HF, _mm256_andnot_si256(DB, BF));
+        __m256i c2 = _mm256_andnot_si256(HF, _mm256_andnot_si256(DB, DH));
+        __m256i c3 = _mm256_andnot_si256(BF, _mm256_andnot_si256(DH, HF));
+
+        __m256i E0 = _mm256_blendv_epi8(E, D, c0);
+        __m256i E1 = _mm256_blendv_epi8(E, F, c1);
+        __m256i E2 = _mm256_blendv_epi8(E, D, c2);
+        __m256i E3 = _mm256_blendv_epi8(E, F, c3);
+
+        // unpack works within 128-bit lanes, put the halves back in order
+        __m256i lo = _mm256_unpacklo_epi8(E0, E1);
+        __m256i hi = _mm256_unpackhi_epi8(E0, E1);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out0 + 2 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out0 + 2 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+
+        lo = _mm256_unpacklo_epi8(E2, E3);
+        hi = _mm256_unpackhi_epi8(E2, E3);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out1 + 2 * x), _mm256_permute2x128_si256(lo, hi, 0x20));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out1 + 2 * x + 32), _mm256_permute2x128_si256(lo, hi, 0x31));
+    }
+}
+
+__attribute__((target("avx2")))
+static void expand_row_avx2(const Byte* in, int w, std::uint32_t fg, std::uint32_t bg, std::uint32_t* out) {
+
+    const __m128i zero = _mm_setzero_si128();
+    const __m256i fgv = _mm256_set1_epi32(static_cast<int>(fg));
+    const __m256i bgv = _mm256_set1_epi32(static_cast<int>(bg));
+
+    for (int x = 0; x < w; x += 8) {
+        // all ones where the pixel is off, sign extended to 32 bits
+        __m128i m = _mm_cmpeq_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(in + x)), zero);
+        __m256i m32 = _mm256_cvtepi8_epi32(m);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + x), _mm256_blendv_epi8(fgv, bgv, m32));
+    }
+}
+
+#endif
+
+static Scale2xRow select_scale2x() {
+#ifdef SCALER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return scale2x_row_avx2;
+    }
+    return scale2x_row_sse2;
+#else
+    return scale2x_row_scalar;
+#endif
+}
+
+static ExpandRow select_expand() {
+#ifdef SCALER_X86
+    if (__builtin_cpu_supports("avx2")) {
+        return expand_row_avx2;
+    }
+    return expand_row_sse2;
+#else
+    return expand_row_scalar;
+#endif
+}
+
+static const Scale2xRow scale2x_row = select_scale2x();
+static const ExpandRow expand_row = select_expand();
+
+// AdvMAME3x; a 3-way interleave gains little from SIMD at this size.
+static void scale3x_row(const Byte* above, const Byte* row, const Byte* below, int w, Byte* out0, Byte* out1, Byte* out2) {
+
+    for (int x = 0; x < w; x++) {
+        int l = std::max(x - 1, 0);
+        int r = std::min(x + 1, w - 1);
+        Byte A = above[l], B = above[x], C = above[r];
+        Byte D = row[l],   E = row[x],   F = row[r];
+        Byte G = below[l], H = below[x], I = below[r];
+
+        bool db = D == B && B != F && D != H;
+        bool bf = B == F && B != D && F != H;
+        bool dh = D == H && D != B && H != F;
+        bool hf = H == F && D != H && B != F;
+
+        out0[3 * x]     = db ? D : E;
+        out0[3 * x + 1] = (db && E != C) || (bf && E != A) ? B : E;
+        out0[3 * x + 2] = bf ? F : E;
+        out1[3 * x]     = (db && E != G) || (dh && E != A) ? D : E;
+        out1[3 * x + 1] = E;
+        out1[3 * x + 2] = (bf && E != I) || (hf && E != C) ? F : E;
+        out2[3 * x]     = dh ? D : E;
+        out2[3 * x + 1] = (dh && E != I) || (hf && E != G) ? H : E;
+        out2[3 * x + 2] = hf ? F : E;
+    }
+}
+
+static int filter_scale(ScaleFilter filter) {
+    switch (filter) {
+        case ScaleFilter::Scale2x: return 2;
+        case ScaleFilter::Scale3x: return 3;
+        case ScaleFilter::Scale4x: return 4;
+        default: return 1;
+    }
+}
+
+Scaler::Scaler(ScaleFilter filter, std::uint32_t foreground, std::uint32_t background):
+    filter(filter), scale(filter_scale(filter)), foreground(foreground), background(background), valid(false) {
+
+    radius = filter == ScaleFilter::Nearest ? 0 : (filter == ScaleFilter::Scale4x ? 2 : 1);
+    if (filter == ScaleFilter::Scale4x) {
+        stage.resize(SCREEN_WIDTH * 2 * SCREEN_HEIGHT * 2);
+    }
+    scaled.resize(width() * height());
+    output.resize(width() * height());
+}
+
+bool Scaler::update(const Byte buffer[], int& first_row, int& last_row) {
+
+    int first = SCREEN_HEIGHT;
+    int last = -1;
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        if (!valid || std::memcmp(previous + y * SCREEN_WIDTH, buffer + y * SCREEN_WIDTH, SCREEN_WIDTH) != 0) {
+            first = std::min(first, y);
+            last = y;
+        }
+    }
+    if (last < 0) {
+        return false;
+    }
+
+    // a row's output depends on its neighbours, rescale those as well
+    scale_rows(buffer, std::max(first - radius, 0), std::min(last + radius, SCREEN_HEIGHT - 1));
+    std::memcpy(previous, buffer, sizeof(previous));
+    valid = true;
+
+    first_row = std::max(first - radius, 0) * scale;
+    last_row = (std::min(last + radius, SCREEN_HEIGHT - 1) + 1) * scale - 1;
+    return true;
+}
+
+void Scaler::scale_rows(const Byte buffer[], int first, int last) {
+
+    int w = width();
+
+    for (int y = first; y <= last; y++) {
+
+        // skip rows whose neighbourhood didn't change since the last frame
+        bool changed = !valid;
+        for (int n = std::max(y - radius, 0); !changed && n <= std::min(y + radius, SCREEN_HEIGHT - 1); n++) {
+            changed = std::memcmp(previous + n * SCREEN_WIDTH, buffer + n * SCREEN_WIDTH, SCREEN_WIDTH) != 0;
+        }
+        if (!changed) {
+            continue;
+        }
+
+        const Byte* row = buffer + y * SCREEN_WIDTH;
+        const Byte* above = buffer + std::max(y - 1, 0) * SCREEN_WIDTH;
+        const Byte* below = buffer + std::min(y + 1, SCREEN_HEIGHT - 1) * SCREEN_WIDTH;
+        Byte* out = &scaled[y * scale * w];
+
+        switch (filter) {
+            case ScaleFilter::Nearest:
+                std::memcpy(out, row, SCREEN_WIDTH);
+            break;
+
+            case ScaleFilter::Scale2x:
+                scale2x_row(above, row, below, SCREEN_WIDTH, out, out + w);
+            break;
+
+            case ScaleFilter::Scale3x:
+                scale3x_row(above, row, below, SCREEN_WIDTH, out, out + w, out + 2 * w);
+            break;
+
+            case ScaleFilter::Scale4x: {
+                // second Scale2x pass over the 2x stage, whose rows 2y - 1
+                // to 2y + 2 come from source rows y - 1 to y + 1
+                int sw = SCREEN_WIDTH * 2;
+                int sh = SCREEN_HEIGHT * 2;
+                for (int n = std::max(y - 1, 0); n <= std::min(y + 1, SCREEN_HEIGHT - 1); n++) {
+                    scale2x_row(buffer + std::max(n - 1, 0) * SCREEN_WIDTH, buffer + n * SCREEN_WIDTH,
+                                buffer + std::min(n + 1, SCREEN_HEIGHT - 1) * SCREEN_WIDTH, SCREEN_WIDTH,
+                                &stage[2 * n * sw], &stage[(2 * n + 1) * sw]);
+                }
+                for (int r = 2 * y; r <= 2 * y + 1; r++) {
+                    scale2x_row(&stage[std::max(r - 1, 0) * sw], &stage[r * sw], &stage[std::min(r + 1, sh - 1) * sw],
+                                sw, &scaled[2 * r * w], &scaled[(2 * r + 1) * w]);
+                }
+            }
+            break;
+        }
+
+        for (int r = y * scale; r < (y + 1) * scale; r++) {
+            expand_row(&scaled[r * w], w, foreground, background, &output[r * w]);
+        }
+    }
+}
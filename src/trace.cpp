@@ -0,0 +1,280 @@
+#include "trace.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__)) && defined(__SSE2__)
+#define TRACE_X86 1
+#include <immintrin.h>
+#endif
+
+static const char trace_magic[4] = { 'C', '8', 'T', 'R' };
+static const std::uint32_t trace_version = 1;
+
+// Difference of record from previous, written to out as sizeof(TraceRecord)
+// bytes: pc relative to the instruction after previous, everything else
+// XORed. Returns the mask of its non-zero bytes.
+static std::uint32_t delta_encode(const TraceRecord& record, const TraceRecord& previous, Byte* out) {
+
+    DoubleByte pc = static_cast<DoubleByte>(record.pc - previous.pc - 2);
+#ifdef TRACE_X86
+    const __m128i* a = reinterpret_cast<const __m128i*>(&record);
+    const __m128i* b = reinterpret_cast<const __m128i*>(&previous);
+    __m128i low = _mm_xor_si128(_mm_loadu_si128(a), _mm_loadu_si128(b));
+    __m128i high = _mm_xor_si128(_mm_loadu_si128(a + 1), _mm_loadu_si128(b + 1));
+    low = _mm_insert_epi16(low, pc, 0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out), low);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + 16), high);
+
+    __m128i zero = _mm_setzero_si128();
+    std::uint32_t zeros = static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(low, zero)))
+        | static_cast<std::uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(high, zero))) << 16;
+    return ~zeros;
+#else
+    const Byte* a = reinterpret_cast<const Byte*>(&record);
+    const Byte* b = reinterpret_cast<const Byte*>(&previous);
+    for (std::size_t i = 0; i < sizeof(TraceRecord); i++) {
+        out[i] = a[i] ^ b[i];
+    }
+    std::memcpy(out, &pc, sizeof(pc));
+
+    std::uint32_t mask = 0;
+    for (std::size_t i = 0; i < sizeof(TraceRecord); i++) {
+        mask |= static_cast<std::uint32_t>(out[i] != 0) << i;
+    }
+    return mask;
+#endif
+}
+
+static void delta_decode(const Byte* in, const TraceRecord& previous, TraceRecord& record) {
+
+    Byte* a = reinterpret_cast<Byte*>(&record);
+    const Byte* b = reinterpret_cast<const Byte*>(&previous);
+    for (std::size_t i = 0; i < sizeof(TraceRecord); i++) {
+        a[i] = in[i] ^ b[i];
+    }
+    DoubleByte pc;
+    std::memcpy(&pc, in, sizeof(pc));
+    record.pc = static_cast<DoubleByte>(pc + previous.pc + 2);
+}
+
+TraceBuffer::TraceBuffer(TraceWriter& writer): writer(writer), records(new TraceRecord[capacity]), head(0), tail(0), head_cache(0), stalls(0) {
+}
+
+std::size_t TraceBuffer::size() const {
+
+    return tail.load(std::memory_order_acquire) - head.load(std::memory_order_relaxed);
+}
+
+std::size_t TraceBuffer::pop(TraceRecord* out, std::size_t max) {
+
+    std::size_t h = head.load(std::memory_order_relaxed);
+    std::size_t count = std::min(max, tail.load(std::memory_order_acquire) - h);
+    for (std::size_t i = 0; i < count; i++) {
+        out[i] = records[(h + i) & (capacity - 1)];
+    }
+    head.store(h + count, std::memory_order_release);
+    return count;
+}
+
+TraceWriter::TraceWriter(const std::string& path): file(path, std::ios::binary | std::ios::trunc), woken(false), stopping(false) {
+
+    if (!file) {
+        throw std::runtime_error("Could not open trace file " + path);
+    }
+    std::uint32_t header[] = { trace_version, sizeof(TraceRecord) };
+    file.write(trace_magic, sizeof(trace_magic));
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+
+    thread = std::thread(&TraceWriter::run, this);
+}
+
+TraceWriter::~TraceWriter() {
+
+    stopping.store(true, std::memory_order_release);
+    ready.notify_one();
+    thread.join();
+}
+
+TraceBuffer& TraceWriter::open_buffer() {
+
+    std::lock_guard<std::mutex> lock(mutex);
+    buffers.push_back(std::unique_ptr<TraceBuffer>(new TraceBuffer(*this)));
+    return *buffers.back();
+}
+
+void TraceWriter::run() {
+
+    typedef std::chrono::steady_clock clock;
+    // a buffer filling slowly is still written out this often
+    const clock::duration flush_period = std::chrono::seconds(1);
+
+    const std::size_t chunk_records = TraceBuffer::chunk_records;
+    std::vector<TraceRecord> batch(chunk_records);
+    std::vector<TraceBuffer*> current;
+    std::vector<clock::time_point> flushed;
+
+    while (true) {
+
+        // read before draining, so the last pass sees every record pushed
+        // before the destructor was called
+        bool stop = stopping.load(std::memory_order_acquire);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            current.clear();
+            for (std::unique_ptr<TraceBuffer>& buffer : buffers) {
+                current.push_back(buffer.get());
+            }
+        }
+        clock::time_point now = clock::now();
+        flushed.resize(current.size(), now);
+
+        bool idle = true;
+        for (std::size_t s = 0; s < current.size(); s++) {
+
+            std::size_t pending = current[s]->size();
+            if (pending == 0 || (pending < chunk_records && !stop && now - flushed[s] < flush_period)) {
+                continue;
+            }
+            while (pending > 0) {
+                std::size_t count = current[s]->pop(batch.data(), std::min(pending, chunk_records));
+                write_chunk(static_cast<std::uint32_t>(s), batch.data(), count);
+                pending -= count;
+            }
+            flushed[s] = now;
+            idle = false;
+        }
+
+        if (!idle) {
+            file.flush();
+        } else if (stop) {
+            break;
+        } else {
+            // a wake racing with the check above is picked up by the next poll
+            std::unique_lock<std::mutex> lock(mutex);
+            ready.wait_for(lock, std::chrono::milliseconds(10), [this] {
+                return woken.load(std::memory_order_acquire) || stopping.load(std::memory_order_acquire);
+            });
+            woken.store(false, std::memory_order_release);
+        }
+    }
+}
+
+void TraceWriter::write_chunk(std::uint32_t stream, const TraceRecord* records, std::size_t count) {
+
+    // at worst a record takes a group byte, four mask bytes and every byte
+    payload.resize(count * (1 + 4 + sizeof(TraceRecord)));
+    Byte* out = payload.data();
+
+    TraceRecord previous = TraceRecord();
+    Byte difference[sizeof(TraceRecord)];
+
+    for (std::size_t r = 0; r < count; r++) {
+
+        std::uint32_t mask = delta_encode(records[r], previous, difference);
+        previous = records[r];
+
+        // a byte saying which bytes of the mask are non-zero, those bytes,
+        // then the non-zero bytes of the difference
+        Byte* groups = out++;
+        Byte group_bits = 0;
+        for (int g = 0; g < 4; g++) {
+            Byte bits = static_cast<Byte>(mask >> (8 * g));
+            *out = bits;
+            out += bits != 0;
+            group_bits |= static_cast<Byte>(bits != 0) << g;
+        }
+        *groups = group_bits;
+
+#ifdef TRACE_X86
+        while (mask) {
+            *out++ = difference[__builtin_ctz(mask)];
+            mask &= mask - 1;
+        }
+#else
+        for (std::size_t i = 0; i < sizeof(TraceRecord); i++) {
+            if ((mask >> i) & 1) {
+                *out++ = difference[i];
+            }
+        }
+#endif
+    }
+
+    std::size_t size = out - payload.data();
+    std::uint32_t header[] = { stream, static_cast<std::uint32_t>(count), static_cast<std::uint32_t>(size) };
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(reinterpret_cast<const char*>(payload.data()), size);
+}
+
+TraceReader::TraceReader(const std::string& path):
+    in(path, std::ios::binary), payload_size(0), offset(0), remaining(0), stream(0), previous(), bytes(0) {
+
+    if (!in) {
+        throw std::runtime_error("Could not open trace file " + path);
+    }
+
+    char magic[sizeof(trace_magic)];
+    std::uint32_t header[2];
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char*>(header), sizeof(header));
+    if (!in || std::memcmp(magic, trace_magic, sizeof(magic)) != 0
+            || header[0] != trace_version || header[1] != sizeof(TraceRecord)) {
+        throw std::runtime_error(path + " is not a chip8 trace");
+    }
+    bytes = sizeof(magic) + sizeof(header);
+}
+
+bool TraceReader::next(TraceRecord& record, std::uint32_t& record_stream) {
+
+    while (remaining == 0) {
+        // a trace cut short, by a crash or while still being written, ends
+        // at its last whole chunk
+        std::uint32_t header[3];
+        if (!in.read(reinterpret_cast<char*>(header), sizeof(header))) {
+            return false;
+        }
+        payload_size = header[2];
+        payload.assign(payload_size + 1 + 4 + sizeof(TraceRecord), 0);
+        if (!in.read(reinterpret_cast<char*>(payload.data()), payload_size)) {
+            return false;
+        }
+        stream = header[0];
+        remaining = header[1];
+        offset = 0;
+        previous = TraceRecord();
+        bytes += sizeof(header) + payload_size;
+    }
+
+    Byte groups = payload[offset++];
+    std::uint32_t mask = 0;
+    for (int g = 0; g < 4; g++) {
+        if ((groups >> g) & 1) {
+            mask |= static_cast<std::uint32_t>(payload[offset++]) << (8 * g);
+        }
+    }
+
+    Byte difference[sizeof(TraceRecord)] = {};
+#ifdef TRACE_X86
+    for (; mask; mask &= mask - 1) {
+        difference[__builtin_ctz(mask)] = payload[offset++];
+    }
+#else
+    for (std::size_t i = 0; i < sizeof(TraceRecord); i++) {
+        if ((mask >> i) & 1) {
+            difference[i] = payload[offset++];
+        }
+    }
+#endif
+    // the payload is padded, so a corrupt record reads past its end
+    // harmlessly and is caught here
+    if (offset > payload_size) {
+        throw std::runtime_error("Corrupt trace chunk");
+    }
+
+    delta_decode(difference, previous, record);
+    previous = record;
+    record_stream = stream;
+    remaining--;
+    return true;
+}
@@ -0,0 +1,232 @@
+#include "video_wall.h"
+#include "display.h"
+#include "keyboard.h"
+#include "frame_pacer.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <stdexcept>
+
+static const std::uint32_t foreground = 0xFFFFFFFF;
+static const std::uint32_t background = 0xFF000000;
+static const std::uint32_t halted_foreground = 0xFFFF4040;
+static const std::uint32_t gutter = 0xFF404040;
+
+VideoWall::VideoWall(const std::vector<std::string>& programs, const VideoWallOptions& options):
+    programs(programs), options(options), generation(0), pending(0), ticks(0), drawn_ticks(0), stopping(false) {
+
+    if (programs.empty() || options.instances < 1) {
+        throw std::runtime_error("Video wall needs at least one program and one instance");
+    }
+
+    // pick the grid closest to the window's aspect ratio
+    double aspect = static_cast<double>(options.window_width * tile_height) / (options.window_height * tile_width);
+    columns = std::max(1, static_cast<int>(std::ceil(std::sqrt(options.instances * aspect))));
+    columns = std::min(columns, options.instances);
+    rows = (options.instances + columns - 1) / columns;
+
+    if (SDL_Init(SDL_INIT_VIDEO) < 0) {
+        throw std::runtime_error(std::string("SDL could not initialize! SDL_Error: ") + SDL_GetError());
+    }
+
+    std::string title = "chip8 video wall (" + std::to_string(options.instances) + " machines)";
+    window = make_window(title.c_str(), SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED,
+                         options.window_width, options.window_height, SDL_WINDOW_SHOWN | SDL_WINDOW_RESIZABLE);
+    renderer = make_renderer(window.get());
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    atlas = make_texture(renderer.get(), columns * tile_width, rows * tile_height);
+    pixels.assign(columns * tile_width * rows * tile_height, gutter);
+
+    int thread_count = options.threads > 0 ? options.threads : static_cast<int>(std::thread::hardware_concurrency());
+    thread_count = std::max(1, std::min(thread_count, options.instances));
+
+    instances.assign(options.instances, Instance{ nullptr, false });
+    pending = thread_count;
+    for (int w = 0; w < thread_count; w++) {
+        int first = options.instances * w / thread_count;
+        int last = options.instances * (w + 1) / thread_count;
+        workers.push_back(std::thread(&VideoWall::work, this, w, thread_count, first, last));
+    }
+
+    // wait for every worker to set up its machines
+    std::unique_lock<std::mutex> lock(mutex);
+    work_done.wait(lock, [this] { return pending == 0; });
+}
+
+VideoWall::~VideoWall() {
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    work_ready.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+    SDL_Quit();
+}
+
+void VideoWall::work(int worker, int worker_count, int first, int last) {
+
+    // pinned first, so the pools and caches created here are placed on
+    // the node this thread keeps running on
+    pin_to_numa_node(worker, worker_count);
+    MachineGroup group(programs, first, last);
+    for (int i = first; i < last; i++) {
+        instances[i].running = &group[i];
+        instances[i].dirty = true;
+    }
+
+    unsigned long seen;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        seen = generation;
+        if (--pending == 0) {
+            work_done.notify_one();
+        }
+    }
+
+    while (true) {
+
+        int count;
+        std::bitset<Chip8::num_keys> pressed;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            work_ready.wait(lock, [this, seen] { return stopping || generation != seen; });
+            if (stopping) {
+                return;
+            }
+            seen = generation;
+            count = ticks;
+            pressed = keys;
+        }
+
+        std::uint32_t drawn = 0;
+        for (int i = first; i < last; i++) {
+            Instance& instance = instances[i];
+            instance.running->machine->set_keys(pressed);
+            for (int t = 0; t < count; t++) {
+                if (instance.running->run_cycle()) {
+                    instance.dirty = true;
+                    drawn |= 1u << t;
+                }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        drawn_ticks |= drawn;
+        if (--pending == 0) {
+            work_done.notify_one();
+        }
+    }
+}
+
+std::uint32_t VideoWall::run_ticks(int count, const std::bitset<Chip8::num_keys>& pressed) {
+
+    std::unique_lock<std::mutex> lock(mutex);
+    ticks = count;
+    keys = pressed;
+    drawn_ticks = 0;
+    pending = static_cast<int>(workers.size());
+    generation++;
+    work_ready.notify_all();
+    work_done.wait(lock, [this] { return pending == 0; });
+    return drawn_ticks;
+}
+
+bool VideoWall::compose(SDL_Rect& changed) {
+
+    int atlas_width = columns * tile_width;
+    int left = atlas_width, top = rows * tile_height, right = 0, bottom = 0;
+
+    for (int i = 0; i < options.instances; i++) {
+
+        Instance& instance = instances[i];
+        if (!instance.dirty) {
+            continue;
+        }
+        instance.dirty = false;
+
+        int x0 = (i % columns) * tile_width;
+        int y0 = (i / columns) * tile_height;
+        std::uint32_t on = instance.running->halted ? halted_foreground : foreground;
+        const Byte* screen = instance.running->machine->screen();
+
+        for (int y = 0; y < SCREEN_HEIGHT; y++) {
+            std::uint32_t* row = &pixels[(y0 + y) * atlas_width + x0];
+            for (int x = 0; x < SCREEN_WIDTH; x++) {
+                row[x] = screen[y * SCREEN_WIDTH + x] ? on : background;
+            }
+        }
+
+        left = std::min(left, x0);
+        top = std::min(top, y0);
+        right = std::max(right, x0 + SCREEN_WIDTH);
+        bottom = std::max(bottom, y0 + SCREEN_HEIGHT);
+    }
+
+    if (right == 0) {
+        return false;
+    }
+    changed.x = left;
+    changed.y = top;
+    changed.w = right - left;
+    changed.h = bottom - top;
+    return true;
+}
+
+void VideoWall::present() {
+
+    SDL_Renderer* pRenderer = renderer.get();
+    int atlas_width = columns * tile_width;
+    int atlas_height = rows * tile_height;
+
+    int w, h;
+    SDL_GetRendererOutputSize(pRenderer, &w, &h);
+    double scale = std::min(static_cast<double>(w) / atlas_width, static_cast<double>(h) / atlas_height);
+    SDL_Rect target = { 0, 0, static_cast<int>(atlas_width * scale), static_cast<int>(atlas_height * scale) };
+    target.x = (w - target.w) / 2;
+    target.y = (h - target.h) / 2;
+
+    SDL_SetRenderDrawColor(pRenderer, 0x00, 0x00, 0x00, 0xFF);
+    SDL_RenderClear(pRenderer);
+    SDL_RenderCopy(pRenderer, atlas.get(), nullptr, &target);
+    SDL_RenderPresent(pRenderer);
+}
+
+void VideoWall::run() {
+
+    Keyboard keyboard;
+    FramePacer pacer(std::chrono::milliseconds(Chip8::SLEEP_TIME_BETWEEN_CYCLES_MS));
+    std::bitset<Chip8::num_keys> pressed;
+
+    while (keyboard.read_key(pressed)) {
+
+        // emulation runs at the same speed as a single machine, in whole
+        // timer cycles, however long compositing and presenting take
+        int due = pacer.cycles_due();
+        if (due > 0) {
+            // every tick that drew is a frame, though only the last is composed
+            std::uint32_t drawn = run_ticks(due, pressed);
+            for (; drawn; drawn &= drawn - 1) {
+                pacer.frame_ready();
+            }
+
+            SDL_Rect changed;
+            if (compose(changed)) {
+                int atlas_width = columns * tile_width;
+                SDL_UpdateTexture(atlas.get(), &changed, &pixels[changed.y * atlas_width + changed.x],
+                                  atlas_width * sizeof(std::uint32_t));
+            }
+        }
+
+        if (pacer.should_present()) {
+            pacer.begin_present();
+            present();
+            pacer.end_present();
+        }
+        pacer.wait();
+    }
+
+    pacer.report(std::cerr);
+}
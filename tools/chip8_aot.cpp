@@ -0,0 +1,361 @@
+// Ahead-of-time compiler from a CHIP-8 ROM to a C++ module.
+//
+// The control flow graph is walked from PROGRAM_START_ADDRESS following
+// 1NNN/2NNN targets, subroutine returns and both sides of every skip. Each
+// basic block becomes one C++ function; the runtime interprets anything
+// not reached this way (BNNN computed jumps, FX0A key waits).
+//
+// Build the output as a shared library and pass it to chip8 --aot:
+//   c++ -O2 -shared -fPIC -I include rom.cpp -o rom.so
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <iterator>
+#include <set>
+#include <string>
+#include <vector>
+#include "aot.h"
+
+static const int PROGRAM_START_ADDRESS = 0x0200;
+
+enum class Flow { Next, Jump, Call, Return, Skip, Unsupported };
+
+static DoubleByte opcode_at(const std::vector<Byte>& memory, int addr) {
+    return (memory[addr] << 8) | memory[addr + 1];
+}
+
+// Control flow effect of opcode; Unsupported for anything left to the
+// interpreter, including invalid opcodes (usually data).
+static Flow classify(DoubleByte opcode) {
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0) return Flow::Next;
+            if (opcode == 0x00EE) return Flow::Return;
+            return Flow::Unsupported;
+        case 0x1000: return Flow::Jump;
+        case 0x2000: return Flow::Call;
+        case 0x3000:
+        case 0x4000: return Flow::Skip;
+        case 0x5000:
+        case 0x9000: return (opcode & 0x000F) == 0 ? Flow::Skip : Flow::Unsupported;
+        case 0x6000:
+        case 0x7000:
+        case 0xA000:
+        case 0xC000:
+        case 0xD000: return Flow::Next;
+        case 0x8000:
+            switch (opcode & 0x000F) {
+                case 0x0: case 0x1: case 0x2: case 0x3: case 0x4:
+                case 0x5: case 0x6: case 0x7: case 0xE:
+                    return Flow::Next;
+            }
+            return Flow::Unsupported;
+        case 0xB000: return Flow::Unsupported;
+        case 0xE000:
+            return ((opcode & 0x00FF) == 0x9E || (opcode & 0x00FF) == 0xA1) ? Flow::Skip : Flow::Unsupported;
+        case 0xF000:
+            switch (opcode & 0x00FF) {
+                case 0x07: case 0x15: case 0x18: case 0x1E:
+                case 0x29: case 0x33: case 0x55: case 0x65:
+                    return Flow::Next;
+            }
+            return Flow::Unsupported;
+    }
+    return Flow::Unsupported;
+}
+
+static bool writes_memory(DoubleByte opcode) {
+    return (opcode & 0xF0FF) == 0xF033 || (opcode & 0xF0FF) == 0xF055;
+}
+
+struct Program {
+    std::vector<Byte> memory;
+    std::set<int> leaders;
+    std::vector<Byte> code_map;
+    int unsupported;
+};
+
+static void add_leader(Program& program, std::vector<int>& worklist, int addr) {
+    if (addr + 1 < AOT_MEMORY_SIZE && program.leaders.insert(addr).second) {
+        worklist.push_back(addr);
+    }
+}
+
+static void walk(Program& program) {
+
+    std::vector<Byte> visited(AOT_MEMORY_SIZE, 0);
+    std::vector<int> worklist;
+    add_leader(program, worklist, PROGRAM_START_ADDRESS);
+
+    while (!worklist.empty()) {
+
+        int addr = worklist.back();
+        worklist.pop_back();
+
+        for (; addr + 1 < AOT_MEMORY_SIZE && !visited[addr]; addr += 2) {
+
+            DoubleByte opcode = opcode_at(program.memory, addr);
+            Flow flow = classify(opcode);
+
+            if (flow == Flow::Unsupported) {
+                program.unsupported++;
+                // the interpreter resumes compiled code after a key wait
+                if ((opcode & 0xF0FF) == 0xF00A) {
+                    add_leader(program, worklist, addr + 2);
+                }
+                break;
+            }
+
+            visited[addr] = 1;
+            program.code_map[addr] = program.code_map[addr + 1] = 1;
+
+            if (flow == Flow::Jump) {
+                add_leader(program, worklist, opcode & 0x0FFF);
+                break;
+            } else if (flow == Flow::Call) {
+                add_leader(program, worklist, opcode & 0x0FFF);
+                add_leader(program, worklist, addr + 2);
+                break;
+            } else if (flow == Flow::Skip) {
+                add_leader(program, worklist, addr + 2);
+                add_leader(program, worklist, addr + 4);
+                break;
+            } else if (flow == Flow::Return) {
+                break;
+            }
+        }
+    }
+}
+
+static std::string hex(int value, int width) {
+    std::ostringstream oss;
+    oss << "0x" << std::hex << std::uppercase << std::setfill('0') << std::setw(width) << value;
+    return oss.str();
+}
+
+static std::string leave(int executed, const std::string& target) {
+    std::ostringstream oss;
+    oss << "c->executed += " << executed << "; return " << target << ";";
+    return oss.str();
+}
+
+// Emits opcode at addr as the statements of a block that has already
+// retired `executed` instructions before it. Returns false after emitting
+// an instruction that ends the block.
+static bool emit_instruction(std::ostream& out, DoubleByte opcode, int addr, int executed) {
+
+    int X = (opcode & 0x0F00) >> 8;
+    int Y = (opcode & 0x00F0) >> 4;
+    int N = opcode & 0x000F;
+    std::string NN = hex(opcode & 0x00FF, 2);
+    std::string NNN = hex(opcode & 0x0FFF, 3);
+    std::string VX = "V[" + std::to_string(X) + "]";
+    std::string VY = "V[" + std::to_string(Y) + "]";
+    std::string next = hex((addr + 2) & AOT_ADDRESS_MASK, 3);
+    std::string skip = hex((addr + 4) & AOT_ADDRESS_MASK, 3);
+    int retired = executed + 1;
+
+    out << "    // " << hex(addr, 3) << ": " << hex(opcode, 4) << "\n    ";
+
+    switch (opcode & 0xF000) {
+        case 0x0000:
+            if (opcode == 0x00E0) {
+                out << "std::memset(c->screen, 0, SCREEN_WIDTH * SCREEN_HEIGHT); c->update_screen = true;\n";
+                return true;
+            }
+            out << leave(retired, "c->stack[--*c->sp] & AOT_ADDRESS_MASK") << "\n";
+            return false;
+        case 0x1000:
+            out << leave(retired, NNN) << "\n";
+            return false;
+        case 0x2000:
+            out << "c->stack[(*c->sp)++] = " << next << "; " << leave(retired, NNN) << "\n";
+            return false;
+        case 0x3000:
+            out << leave(retired, VX + " == " + NN + " ? " + skip + " : " + next) << "\n";
+            return false;
+        case 0x4000:
+            out << leave(retired, VX + " != " + NN + " ? " + skip + " : " + next) << "\n";
+            return false;
+        case 0x5000:
+            out << leave(retired, VX + " == " + VY + " ? " + skip + " : " + next) << "\n";
+            return false;
+        case 0x6000:
+            out << VX << " = " << NN << ";\n";
+            return true;
+        case 0x7000:
+            out << VX << " += " << NN << ";\n";
+            return true;
+        case 0x8000:
+            switch (N) {
+                case 0x0: out << VX << " = " << VY << ";\n"; break;
+                case 0x1: out << VX << " |= " << VY << ";\n"; break;
+                case 0x2: out << VX << " &= " << VY << ";\n"; break;
+                case 0x3: out << VX << " ^= " << VY << ";\n"; break;
+                case 0x4: out << "V[15] = " << VX << " > (0xFF - " << VY << ") ? 1 : 0; " << VX << " += " << VY << ";\n"; break;
+                case 0x5: out << "V[15] = " << VX << " > " << VY << " ? 1 : 0; " << VX << " -= " << VY << ";\n"; break;
+                case 0x6: out << "V[15] = " << VX << " & 0x01; " << VX << " >>= 1;\n"; break;
+                case 0x7: out << "V[15] = " << VY << " > " << VX << " ? 1 : 0; " << VX << " = " << VY << " - " << VX << ";\n"; break;
+                case 0xE: out << "V[15] = " << VX << " >> 7; " << VX << " <<= 1;\n"; break;
+            }
+            return true;
+        case 0x9000:
+            out << leave(retired, VX + " != " + VY + " ? " + skip + " : " + next) << "\n";
+            return false;
+        case 0xA000:
+            out << "*c->I = " << NNN << ";\n";
+            return true;
+        case 0xC000:
+            out << VX << " = next_random(*c->rng_state) & " << NN << ";\n";
+            return true;
+        case 0xD000:
+            out << "aot_draw(c, " << X << ", " << Y << ", " << N << ");\n";
+            return true;
+        case 0xE000:
+            if ((opcode & 0x00FF) == 0x9E) {
+                out << leave(retired, "aot_key(c, " + VX + ") ? " + skip + " : " + next) << "\n";
+            } else {
+                out << leave(retired, "!aot_key(c, " + VX + ") ? " + skip + " : " + next) << "\n";
+            }
+            return false;
+    }
+
+    // 0xF000
+    switch (opcode & 0x00FF) {
+        case 0x07: out << VX << " = *c->delay_timer;\n"; break;
+        case 0x15: out << "*c->delay_timer = " << VX << ";\n"; break;
+        case 0x18: out << "*c->sound_timer = " << VX << ";\n"; break;
+        case 0x1E: out << "*c->I = (*c->I + " << VX << ") & AOT_ADDRESS_MASK;\n"; break;
+        case 0x29: out << "*c->I = " << VX << " * 5;\n"; break;
+        case 0x33:
+            out << "aot_store(c, *c->I, " << VX << " / 100); "
+                << "aot_store(c, *c->I + 1, (" << VX << " / 10) % 10); "
+                << "aot_store(c, *c->I + 2, (" << VX << " % 100) % 10);\n";
+            break;
+        case 0x55:
+            out << "for (int i = 0; i <= " << X << "; i++) aot_store(c, *c->I + i, V[i]);\n";
+            break;
+        case 0x65:
+            out << "for (int i = 0; i <= " << X << "; i++) V[i] = c->memory[(*c->I + i) & AOT_ADDRESS_MASK];\n";
+            break;
+    }
+
+    // compiled code may just have been overwritten
+    if (writes_memory(opcode)) {
+        out << "    if (c->code_written) { " << leave(retired, next) << " }\n";
+    }
+    return true;
+}
+
+static int emit_block(std::ostream& out, const Program& program, int start) {
+
+    out << "static DoubleByte block_" << std::hex << start << std::dec << "(AotContext* c) {\n"
+        << "    Byte* V = c->V;\n"
+        << "    (void)V;\n";
+
+    int executed = 0;
+    int addr = start;
+    while (true) {
+
+        DoubleByte opcode = opcode_at(program.memory, addr);
+        if (classify(opcode) == Flow::Unsupported) {
+            out << "    " << leave(executed, hex(addr, 3)) << "\n";
+            break;
+        }
+
+        bool falls_through = emit_instruction(out, opcode, addr, executed);
+        executed++;
+        addr += 2;
+        if (!falls_through) {
+            break;
+        }
+        if (program.leaders.count(addr) || addr + 1 >= AOT_MEMORY_SIZE) {
+            out << "    " << leave(executed, hex(addr, 3)) << "\n";
+            break;
+        }
+    }
+    out << "}\n\n";
+    return executed;
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc != 3) {
+        std::cerr << "Usage: chip8_aot rom output.cpp" << std::endl;
+        return 1;
+    }
+
+    std::ifstream rom_file(argv[1], std::ios::binary);
+    if (!rom_file.is_open()) {
+        std::cerr << "File not found: " << argv[1] << std::endl;
+        return 1;
+    }
+    std::vector<Byte> rom((std::istreambuf_iterator<char>(rom_file)), std::istreambuf_iterator<char>());
+
+    if (rom.size() > static_cast<std::size_t>(AOT_MEMORY_SIZE - PROGRAM_START_ADDRESS)) {
+        std::cerr << "Can't compile. Program size too big." << std::endl;
+        return 1;
+    }
+
+    Program program;
+    program.memory.assign(AOT_MEMORY_SIZE, 0);
+    program.code_map.assign(AOT_MEMORY_SIZE, 0);
+    program.unsupported = 0;
+    std::copy(rom.begin(), rom.end(), program.memory.begin() + PROGRAM_START_ADDRESS);
+
+    walk(program);
+
+    std::ofstream out(argv[2]);
+    if (!out.is_open()) {
+        std::cerr << "Can't write " << argv[2] << std::endl;
+        return 1;
+    }
+
+    out << "// Generated by chip8_aot from " << argv[1] << ". Do not edit.\n"
+        << "#include \"aot.h\"\n\n";
+
+    std::vector<int> blocks;
+    int compiled = 0;
+    for (int leader : program.leaders) {
+        if (classify(opcode_at(program.memory, leader)) == Flow::Unsupported) {
+            continue;
+        }
+        compiled += emit_block(out, program, leader);
+        blocks.push_back(leader);
+    }
+
+    out << "static const Byte rom[] = {";
+    for (std::size_t i = 0; i < rom.size(); i++) {
+        out << (i % 16 ? " " : "\n    ") << hex(rom[i], 2) << ",";
+    }
+    out << "\n    0x00\n};\n\n";
+
+    out << "static const Byte code_map[AOT_MEMORY_SIZE] = {";
+    for (int i = 0; i < AOT_MEMORY_SIZE; i++) {
+        out << (i ? "," : "") << (i % 32 ? "" : "\n    ") << static_cast<int>(program.code_map[i]);
+    }
+    out << "\n};\n\n";
+
+    out << "static AotBlock blocks[AOT_MEMORY_SIZE];\n\n"
+        << "extern \"C\" const AotModule* " << CHIP8_AOT_ENTRY << "() {\n"
+        << "    static AotModule module;\n"
+        << "    if (!module.abi_version) {\n";
+    for (int leader : blocks) {
+        out << "        blocks[" << hex(leader, 3) << "] = block_" << std::hex << leader << std::dec << ";\n";
+    }
+    out << "        module.rom = rom;\n"
+        << "        module.rom_size = " << rom.size() << ";\n"
+        << "        module.blocks = blocks;\n"
+        << "        module.code_map = code_map;\n"
+        << "        module.abi_version = CHIP8_AOT_ABI_VERSION;\n"
+        << "    }\n"
+        << "    return &module;\n"
+        << "}\n";
+
+    std::cout << blocks.size() << " blocks, " << compiled << " instructions compiled, "
+              << program.unsupported << " left to the interpreter" << std::endl;
+    return 0;
+}
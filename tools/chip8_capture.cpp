@@ -0,0 +1,137 @@
+// Runs many machines headless, as fast as they go, and captures every
+// timer cycle's screen of each to its own Y4M video or PBM sequence.
+//
+// Machines are split over worker threads as in the video wall, each
+// pressing pseudo random keys. Frames are handed to FrameCapture, which
+// encodes and writes them on its own threads; a worker waits for a free
+// buffer when encoding falls behind, unless --drop-frames is given.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "frame_capture.h"
+#include "machine_pool.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* usage =
+    "Usage: chip8_capture [--instances N] [--threads N] [--encoders N] [--buffers N] [--cycles N]\n"
+    "                     [--drop-frames] [--format y4m|pbm] [--out DIRECTORY] rom...";
+
+static std::string stream_path(const std::string& directory, int index, const std::string& rom) {
+
+    std::string name = rom.substr(rom.find_last_of('/') + 1);
+    name = name.substr(0, name.find_last_of('.'));
+    return directory + "/" + std::to_string(index) + "_" + name;
+}
+
+static void work(const std::vector<std::string>& roms, const std::vector<CaptureStream*>& streams,
+                 int worker, int worker_count, int first, int last, long cycles, FrameCapture& capture) {
+
+    pin_to_numa_node(worker, worker_count);
+    MachineGroup group(roms, first, last);
+    std::vector<std::uint32_t> seeds;
+    for (int i = first; i < last; i++) {
+        seeds.push_back(static_cast<std::uint32_t>(i) * 2654435761u + 1);
+    }
+
+    for (long c = 0; c < cycles; c++) {
+        for (int i = first; i < last; i++) {
+            RunningMachine& running = group[i];
+            running.machine->set_keys(random_keys(seeds[i - first]));
+            running.run_cycle();
+            capture.submit(*streams[i], running.machine->screen());
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    int instances = 1;
+    int threads = 0;
+    long cycles = 3000;
+    std::string directory = ".";
+    FrameCaptureOptions options;
+    std::vector<std::string> roms;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (std::strcmp(argv[arg], "--instances") == 0 && arg + 1 < argc) {
+            instances = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+            threads = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--encoders") == 0 && arg + 1 < argc) {
+            options.threads = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--buffers") == 0 && arg + 1 < argc) {
+            options.buffers = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--cycles") == 0 && arg + 1 < argc) {
+            cycles = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--drop-frames") == 0) {
+            options.wait_for_buffers = false;
+        } else if (std::strcmp(argv[arg], "--format") == 0 && arg + 1 < argc) {
+            std::string format = argv[++arg];
+            if (format != "y4m" && format != "pbm") {
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+            options.format = format == "pbm" ? CaptureFormat::Pbm : CaptureFormat::Y4m;
+        } else if (std::strcmp(argv[arg], "--out") == 0 && arg + 1 < argc) {
+            directory = argv[++arg];
+        } else {
+            roms.push_back(argv[arg]);
+        }
+    }
+
+    if (roms.empty() || instances < 1 || cycles < 1) {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+
+    int thread_count = threads > 0 ? threads : static_cast<int>(std::thread::hardware_concurrency());
+    thread_count = std::max(1, std::min(thread_count, instances));
+    options.frame_rate = 1000 / Chip8::SLEEP_TIME_BETWEEN_CYCLES_MS;
+
+    double seconds;
+    CaptureStats stats;
+    Clock::time_point start = Clock::now();
+    try {
+        FrameCapture capture(options);
+        std::vector<CaptureStream*> streams;
+        for (int i = 0; i < instances; i++) {
+            streams.push_back(&capture.open_stream(stream_path(directory, i, roms[i % roms.size()])));
+        }
+
+        std::vector<std::thread> workers;
+        for (int w = 0; w < thread_count; w++) {
+            workers.push_back(std::thread(work, std::cref(roms), std::cref(streams), w, thread_count,
+                                          instances * w / thread_count, instances * (w + 1) / thread_count,
+                                          cycles, std::ref(capture)));
+        }
+        for (std::thread& worker : workers) {
+            worker.join();
+        }
+        seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        stats = capture.stats();
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    double written_seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+    double real_time = static_cast<double>(cycles) / options.frame_rate;
+    std::cout << std::fixed << std::setprecision(2)
+              << instances << " machines, " << cycles << " cycles each in " << seconds << "s ("
+              << real_time / seconds << "x real time)" << std::endl
+              << stats.frames << " frames: " << stats.duplicates << " duplicates, "
+              << stats.dropped << " dropped; all written after " << written_seconds << "s" << std::endl;
+    if (stats.dropped > 0) {
+        std::cerr << stats.dropped << " frames dropped; the streams that dropped them end early" << std::endl;
+        return 1;
+    }
+    return 0;
+}
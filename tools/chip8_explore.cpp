@@ -0,0 +1,92 @@
+// Searches the key inputs of a ROM for the sequence that maximises an
+// objective, with a parallel beam search or Monte Carlo tree search.
+//
+// Objectives: a byte of memory (--memory ADDR), a register (--register X),
+// or by default the number of lit pixels on the screen.
+
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <stdexcept>
+#include <string>
+#include "explorer.h"
+
+static const char* usage =
+    "Usage: chip8_explore [--mcts] [--depth N] [--cycles N] [--beam N] [--iterations N]\n"
+    "                     [--threads N] [--seed N] [--memory ADDR | --register X] rom";
+
+int main(int argc, char* argv[])
+{
+    ExplorerOptions options;
+    Explorer::Objective objective = [](const Chip8& machine) {
+        int lit = 0;
+        for (int i = 0; i < SCREEN_WIDTH * SCREEN_HEIGHT; i++) {
+            lit += machine.screen()[i] != 0;
+        }
+        return static_cast<double>(lit);
+    };
+    std::string rom;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (std::strcmp(argv[arg], "--mcts") == 0) {
+            options.algorithm = ExplorerOptions::Algorithm::Mcts;
+        } else if (std::strcmp(argv[arg], "--depth") == 0 && arg + 1 < argc) {
+            options.depth = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--cycles") == 0 && arg + 1 < argc) {
+            options.cycles_per_action = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--beam") == 0 && arg + 1 < argc) {
+            options.beam_width = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--iterations") == 0 && arg + 1 < argc) {
+            options.iterations = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--threads") == 0 && arg + 1 < argc) {
+            options.threads = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--seed") == 0 && arg + 1 < argc) {
+            options.seed = static_cast<std::uint32_t>(std::atol(argv[++arg]));
+        } else if (std::strcmp(argv[arg], "--memory") == 0 && arg + 1 < argc) {
+            int address = static_cast<int>(std::strtol(argv[++arg], nullptr, 0)) % Chip8::memory_size;
+            objective = [address](const Chip8& machine) { return static_cast<double>(machine.ram()[address]); };
+        } else if (std::strcmp(argv[arg], "--register") == 0 && arg + 1 < argc) {
+            int x = static_cast<int>(std::strtol(argv[++arg], nullptr, 16)) % Chip8::num_registers;
+            objective = [x](const Chip8& machine) { return static_cast<double>(machine.registers()[x]); };
+        } else {
+            rom = argv[arg];
+        }
+    }
+
+    if (rom.empty() || options.depth < 1 || options.cycles_per_action < 1 || options.beam_width < 1) {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+
+    try {
+        Chip8 start;
+        start.load_program(rom);
+
+        Explorer explorer(start, objective, options);
+        ExplorerResult result = explorer.run();
+
+        long nodes = result.expanded + result.duplicates + result.failed;
+        std::cout << std::fixed << std::setprecision(2)
+                  << nodes << " nodes in " << result.seconds << "s ("
+                  << std::setprecision(0) << nodes * 60.0 / result.seconds << " per minute)" << std::endl
+                  << "  " << result.expanded << " expanded, " << result.duplicates << " duplicate states, "
+                  << result.failed << " invalid instruction" << std::endl
+                  << "best score " << std::setprecision(2) << result.best_score << " after "
+                  << result.actions.size() << " actions of " << options.cycles_per_action << " cycles" << std::endl;
+
+        std::cout << "keys:";
+        for (int key : result.actions) {
+            std::cout << ' ';
+            if (key < 0) {
+                std::cout << '-';
+            } else {
+                std::cout << std::hex << std::uppercase << key << std::dec;
+            }
+        }
+        std::cout << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,232 @@
+// Mines a ROM corpus for the most frequently executed opcode sequences.
+//
+// Every ROM is run headless with pseudo random key presses and the executed
+// opcodes are counted as 2- and 3-grams of opcode classes (ANNN, DXYN, ...).
+// The superinstructions in DecodeCache are the top entries of this table.
+//
+// With --bench, every ROM is also checked for equivalence between fused and
+// plain execution, and timed with and without fusion.
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <map>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "chip8.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static std::string opcode_class(DoubleByte opcode) {
+
+    static const char* digits = "0123456789ABCDEF";
+    std::string text = std::string(1, digits[opcode >> 12]);
+
+    switch (opcode & 0xF000) {
+        case 0x0000: text = opcode == 0x00E0 || opcode == 0x00EE ? std::string("00E") + digits[opcode & 0xF] : "0NNN"; break;
+        case 0x1000: case 0x2000: case 0xA000: case 0xB000: text += "NNN"; break;
+        case 0x3000: text += (opcode & 0x00FF) ? "XNN" : "X00"; break;
+        case 0x4000: case 0x6000: case 0x7000: case 0xC000: text += "XNN"; break;
+        case 0x5000: case 0x9000: text += "XY0"; break;
+        case 0x8000: text += std::string("XY") + digits[opcode & 0xF]; break;
+        case 0xD000: text += "XYN"; break;
+        default:
+            text += std::string("X") + digits[(opcode >> 4) & 0xF] + digits[opcode & 0xF];
+        break;
+    }
+    return text;
+}
+
+struct NgramRecorder {
+
+    std::map<std::string, long> counts[2];
+    std::string previous[2];
+    long total;
+
+    NgramRecorder(): total(0) {}
+
+    void start_rom() {
+        previous[0].clear();
+        previous[1].clear();
+    }
+
+    void before_step(Chip8&) {}
+
+    void after_step(Chip8&, DoubleByte opcode) {
+
+        std::string current = opcode_class(opcode);
+        if (!previous[1].empty()) {
+            counts[0][previous[1] + " " + current]++;
+            if (!previous[0].empty()) {
+                counts[1][previous[0] + " " + previous[1] + " " + current]++;
+            }
+        }
+        previous[0] = previous[1];
+        previous[1] = current;
+        total++;
+    }
+};
+
+static void mine(const std::string& rom, long steps, NgramRecorder& recorder) {
+
+    Chip8 chip8;
+    chip8.load_program(rom);
+    recorder.start_rom();
+
+    std::uint32_t seed = 1;
+    try {
+        for (long i = 0; i < steps; i++) {
+            if (i % Chip8::INSTRUCTIONS_PER_CYCLE == 0) {
+                chip8.update_timers();
+                chip8.set_keys(random_keys(seed));
+            }
+            chip8.step(recorder);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << rom << ": " << e.what() << std::endl;
+    }
+}
+
+static void print_top(const std::map<std::string, long>& counts, long total, int top) {
+
+    std::vector<std::pair<long, std::string> > sorted;
+    for (const auto& entry : counts) {
+        sorted.push_back(std::make_pair(entry.second, entry.first));
+    }
+    std::sort(sorted.rbegin(), sorted.rend());
+
+    for (int i = 0; i < top && i < static_cast<int>(sorted.size()); i++) {
+        std::cout << std::setw(20) << std::left << sorted[i].second << std::right
+                  << std::setw(12) << sorted[i].first
+                  << std::setw(8) << std::fixed << std::setprecision(2)
+                  << 100.0 * sorted[i].first / total << "%" << std::endl;
+    }
+}
+
+// Runs machine for at least steps instructions, returning the nanoseconds
+// taken and counting the calls to step in dispatches.
+template<typename Step>
+static double time_run(const std::string& rom, long steps, Step step, long& dispatches) {
+
+    Chip8 chip8;
+    chip8.load_program(rom);
+    std::uint32_t seed = 1;
+    long cycle_end = 0;
+
+    Clock::time_point start = Clock::now();
+    try {
+        for (long i = 0; i < steps; ) {
+            if (i >= cycle_end) {
+                chip8.update_timers();
+                chip8.set_keys(random_keys(seed));
+                cycle_end += Chip8::INSTRUCTIONS_PER_CYCLE;
+            }
+            i += step(chip8);
+            dispatches++;
+        }
+    } catch (const std::exception&) {
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+// Runs fused and plain execution in lockstep, false on the first difference.
+static bool equivalent(const std::string& rom, long steps) {
+
+    Chip8 fused;
+    fused.load_program(rom);
+    Chip8 plain(fused);
+    DecodeCache cache;
+    std::uint32_t seed = 1;
+    long cycle_end = 0;
+
+    try {
+        for (long i = 0; i < steps; ) {
+            if (i >= cycle_end) {
+                std::bitset<Chip8::num_keys> keys = random_keys(seed);
+                fused.update_timers();
+                fused.set_keys(keys);
+                plain.update_timers();
+                plain.set_keys(keys);
+                cycle_end += Chip8::INSTRUCTIONS_PER_CYCLE;
+            }
+            int n = fused.step(cache);
+            for (int k = 0; k < n; k++) {
+                plain.step();
+            }
+            i += n;
+            if (fused != plain) {
+                return false;
+            }
+        }
+    } catch (const std::exception&) {
+    }
+    return true;
+}
+
+static void bench(const std::string& rom, long steps) {
+
+    DecodeCache unfused(false);
+    DecodeCache fused(true);
+    long plain_dispatches = 0, unfused_dispatches = 0, fused_dispatches = 0;
+
+    double plain_ns = time_run(rom, steps, [](Chip8& c) { c.step(); return 1; }, plain_dispatches);
+    double unfused_ns = time_run(rom, steps, [&unfused](Chip8& c) { return c.step(unfused); }, unfused_dispatches);
+    double fused_ns = time_run(rom, steps, [&fused](Chip8& c) { return c.step(fused); }, fused_dispatches);
+
+    std::cout << rom << (equivalent(rom, steps) ? "" : " NOT EQUIVALENT") << std::endl
+              << std::fixed << std::setprecision(2)
+              << "  dispatches " << fused_dispatches << " fused, " << plain_dispatches << " plain ("
+              << 100.0 * (1.0 - static_cast<double>(fused_dispatches) / plain_dispatches) << "% fewer)" << std::endl
+              << "  ns/instruction: plain " << plain_ns / steps
+              << ", pre-decoded " << unfused_ns / steps
+              << ", fused " << fused_ns / steps
+              << " (speedup " << plain_ns / fused_ns << "x)" << std::endl;
+}
+
+int main(int argc, char* argv[])
+{
+    long steps = 1000000;
+    int top = 20;
+    bool run_bench = false;
+    std::vector<std::string> roms;
+
+    for (int arg = 1; arg < argc; arg++) {
+        if (std::strcmp(argv[arg], "--steps") == 0 && arg + 1 < argc) {
+            steps = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--top") == 0 && arg + 1 < argc) {
+            top = std::atoi(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--bench") == 0) {
+            run_bench = true;
+        } else {
+            roms.push_back(argv[arg]);
+        }
+    }
+
+    if (roms.empty()) {
+        std::cerr << "Usage: chip8_ngrams [--steps N] [--top K] [--bench] rom..." << std::endl;
+        return 1;
+    }
+
+    NgramRecorder recorder;
+    for (const std::string& rom : roms) {
+        mine(rom, steps, recorder);
+    }
+
+    std::cout << recorder.total << " instructions executed" << std::endl;
+    for (int n = 0; n < 2; n++) {
+        std::cout << std::endl << "top " << n + 2 << "-grams" << std::endl;
+        print_top(recorder.counts[n], recorder.total, top);
+    }
+
+    if (run_bench) {
+        std::cout << std::endl;
+        for (const std::string& rom : roms) {
+            bench(rom, steps);
+        }
+    }
+    return 0;
+}
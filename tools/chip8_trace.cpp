@@ -0,0 +1,293 @@
+// Records, inspects and compares binary execution traces.
+//
+//   record ROM TRACE [--steps N]    run ROM headless with pseudo random keys
+//                                   and trace it, timing traced and untraced
+//   info TRACE                      records per stream and bytes per record
+//   dump TRACE [--from N] [--count N]
+//   query TRACE (--pc ADDR | --opcode PATTERN | --write ADDR)
+//   diff TRACE TRACE [--context N]  first record where the traces differ
+//
+// Every command reads stream 0 unless given --stream S. Records are printed
+// with the registers that changed since the previous record of the stream.
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <iomanip>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "trace.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static const char* usage =
+    "Usage: chip8_trace record ROM TRACE [--steps N]\n"
+    "       chip8_trace info TRACE\n"
+    "       chip8_trace dump TRACE [--stream S] [--from N] [--count N]\n"
+    "       chip8_trace query TRACE [--stream S] (--pc ADDR | --opcode PATTERN | --write ADDR)\n"
+    "       chip8_trace diff TRACE TRACE [--stream S] [--context N]";
+
+struct Arguments {
+    std::vector<std::string> files;
+    std::uint32_t stream = 0;
+    long steps = 10000000;
+    long from = 0;
+    long count = 100;
+    long context = 5;
+    bool has_pc = false;
+    bool has_write = false;
+    bool has_opcode = false;
+    DoubleByte address = 0;
+    DoubleByte pattern = 0;
+    DoubleByte mask = 0;
+};
+
+static void print_record(long index, const TraceRecord& record, const TraceRecord* previous) {
+
+    std::cout << std::setw(10) << std::setfill(' ') << index << "  "
+              << std::hex << std::uppercase << std::setfill('0')
+              << std::setw(3) << record.pc << ": " << std::setw(4) << record.opcode
+              << "  I=" << std::setw(3) << record.I
+              << " sp=" << static_cast<int>(record.sp)
+              << " dt=" << std::setw(2) << static_cast<int>(record.delay_timer)
+              << " st=" << std::setw(2) << static_cast<int>(record.sound_timer);
+    if (record.keys) {
+        std::cout << " keys=" << std::setw(4) << record.keys;
+    }
+    for (int i = 0; i < Chip8::num_registers; i++) {
+        if (!previous || previous->V[i] != record.V[i]) {
+            std::cout << " V" << i << "=" << std::setw(2) << static_cast<int>(record.V[i]);
+        }
+    }
+    if (record.write_length) {
+        std::cout << " wrote " << std::setw(3) << record.write_address
+                  << std::dec << "+" << static_cast<int>(record.write_length);
+    }
+    std::cout << std::dec << std::nouppercase << std::setfill(' ') << std::endl;
+}
+
+// Reads the records of one stream, keeping the one before for printing.
+class StreamReader {
+
+public:
+    StreamReader(const std::string& path, std::uint32_t stream): reader(path), stream(stream), index(-1), current(), previous(), has_previous(false) {}
+
+    bool next() {
+
+        has_previous = index >= 0;
+        previous = current;
+        std::uint32_t s;
+        while (reader.next(current, s)) {
+            if (s == stream) {
+                index++;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    TraceReader reader;
+    std::uint32_t stream;
+    long index;
+    TraceRecord current;
+    TraceRecord previous;
+    bool has_previous;
+};
+
+// Runs steps instructions through hooks and returns the nanoseconds taken.
+template<typename Hooks>
+static double run(const std::string& rom, long steps, Hooks& hooks) {
+
+    Chip8 chip8;
+    chip8.load_program(rom);
+    std::uint32_t seed = 1;
+
+    Clock::time_point start = Clock::now();
+    try {
+        for (long i = 0; i < steps; i++) {
+            if (i % Chip8::INSTRUCTIONS_PER_CYCLE == 0) {
+                chip8.update_timers();
+                chip8.set_keys(random_keys(seed));
+            }
+            chip8.step(hooks);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << rom << ": " << e.what() << std::endl;
+    }
+    return std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+}
+
+static int record(const Arguments& args) {
+
+    NullHooks null_hooks;
+    double plain_ns = run(args.files[0], args.steps, null_hooks);
+
+    double traced_ns;
+    long stalls;
+    {
+        TraceWriter writer(args.files[1]);
+        TraceBuffer& buffer = writer.open_buffer();
+        TraceHooks hooks(buffer);
+        traced_ns = run(args.files[0], args.steps, hooks);
+        stalls = buffer.stall_count();
+    }
+
+    std::cout << std::fixed << std::setprecision(2)
+              << "ns/instruction: untraced " << plain_ns / args.steps
+              << ", traced " << traced_ns / args.steps
+              << " (" << traced_ns / plain_ns << "x), writer stalls " << stalls << std::endl;
+    return 0;
+}
+
+static int info(const Arguments& args) {
+
+    TraceReader reader(args.files[0]);
+    std::map<std::uint32_t, long> records;
+    TraceRecord record;
+    std::uint32_t stream;
+    long total = 0;
+    while (reader.next(record, stream)) {
+        records[stream]++;
+        total++;
+    }
+
+    for (const auto& entry : records) {
+        std::cout << "stream " << entry.first << ": " << entry.second << " records" << std::endl;
+    }
+    std::cout << reader.bytes_read() << " bytes, " << std::fixed << std::setprecision(2)
+              << (total ? static_cast<double>(reader.bytes_read()) / total : 0.0) << " bytes/record ("
+              << sizeof(TraceRecord) << " unencoded)" << std::endl;
+    return 0;
+}
+
+static int dump(const Arguments& args) {
+
+    StreamReader stream(args.files[0], args.stream);
+    while (stream.next() && stream.index < args.from + args.count) {
+        if (stream.index >= args.from) {
+            print_record(stream.index, stream.current, stream.has_previous ? &stream.previous : nullptr);
+        }
+    }
+    return 0;
+}
+
+static int query(const Arguments& args) {
+
+    StreamReader stream(args.files[0], args.stream);
+    long matches = 0;
+    while (stream.next()) {
+        const TraceRecord& record = stream.current;
+        bool match = (args.has_pc && record.pc == args.address)
+            || (args.has_opcode && (record.opcode & args.mask) == args.pattern)
+            || (args.has_write && ((args.address - record.write_address) & Chip8::address_mask) < record.write_length);
+        if (match) {
+            print_record(stream.index, record, stream.has_previous ? &stream.previous : nullptr);
+            matches++;
+        }
+    }
+    std::cout << matches << " matching records" << std::endl;
+    return 0;
+}
+
+static int diff(const Arguments& args) {
+
+    StreamReader a(args.files[0], args.stream);
+    StreamReader b(args.files[1], args.stream);
+    std::deque<TraceRecord> context;
+
+    while (true) {
+        bool has_a = a.next();
+        bool has_b = b.next();
+
+        if (!has_a || !has_b) {
+            if (has_a == has_b) {
+                std::cout << "traces are identical, " << a.index + 1 << " records" << std::endl;
+                return 0;
+            }
+            std::cout << (has_a ? args.files[1] : args.files[0]) << " ends after "
+                      << std::min(a.index, b.index) + 1 << " records" << std::endl;
+            return 1;
+        }
+
+        if (std::memcmp(&a.current, &b.current, sizeof(TraceRecord)) != 0) {
+            std::cout << "traces differ at record " << a.index << std::endl;
+            long index = a.index - static_cast<long>(context.size());
+            for (std::size_t i = 0; i < context.size(); i++, index++) {
+                print_record(index, context[i], i ? &context[i - 1] : nullptr);
+            }
+            const TraceRecord* previous = context.empty() ? nullptr : &context.back();
+            std::cout << "< " << args.files[0] << std::endl;
+            print_record(a.index, a.current, previous);
+            std::cout << "> " << args.files[1] << std::endl;
+            print_record(b.index, b.current, previous);
+            return 1;
+        }
+
+        context.push_back(a.current);
+        if (static_cast<long>(context.size()) > args.context) {
+            context.pop_front();
+        }
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    if (argc < 3) {
+        std::cerr << usage << std::endl;
+        return 1;
+    }
+
+    std::string command = argv[1];
+    Arguments args;
+
+    for (int arg = 2; arg < argc; arg++) {
+        if (std::strcmp(argv[arg], "--stream") == 0 && arg + 1 < argc) {
+            args.stream = static_cast<std::uint32_t>(std::atol(argv[++arg]));
+        } else if (std::strcmp(argv[arg], "--steps") == 0 && arg + 1 < argc) {
+            args.steps = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--from") == 0 && arg + 1 < argc) {
+            args.from = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--count") == 0 && arg + 1 < argc) {
+            args.count = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--context") == 0 && arg + 1 < argc) {
+            args.context = std::atol(argv[++arg]);
+        } else if (std::strcmp(argv[arg], "--pc") == 0 && arg + 1 < argc) {
+            args.has_pc = true;
+            args.address = static_cast<DoubleByte>(std::strtoul(argv[++arg], nullptr, 16));
+        } else if (std::strcmp(argv[arg], "--write") == 0 && arg + 1 < argc) {
+            args.has_write = true;
+            args.address = static_cast<DoubleByte>(std::strtoul(argv[++arg], nullptr, 16));
+        } else if (std::strcmp(argv[arg], "--opcode") == 0 && arg + 1 < argc) {
+            args.has_opcode = Chip8::parse_opcode_pattern(argv[++arg], args.pattern, args.mask);
+            if (!args.has_opcode) {
+                std::cerr << usage << std::endl;
+                return 1;
+            }
+        } else {
+            args.files.push_back(argv[arg]);
+        }
+    }
+
+    try {
+        if (command == "record" && args.files.size() == 2 && args.steps > 0) {
+            return record(args);
+        } else if (command == "info" && args.files.size() == 1) {
+            return info(args);
+        } else if (command == "dump" && args.files.size() == 1) {
+            return dump(args);
+        } else if (command == "query" && args.files.size() == 1 && (args.has_pc || args.has_opcode || args.has_write)) {
+            return query(args);
+        } else if (command == "diff" && args.files.size() == 2) {
+            return diff(args);
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    std::cerr << usage << std::endl;
+    return 1;
+}